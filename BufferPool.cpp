@@ -0,0 +1,65 @@
+#include "BufferPool.hpp"
+
+BufferPool::BufferPool()
+{
+	for (size_t i = 0; i < BUFFER_POOL_CLASSES; i++)
+	{
+		_classes[i].size = static_cast<size_t>(BUFFER_POOL_MIN) << i;
+		_classes[i].inUse = 0;
+	}
+}
+
+BufferPool::~BufferPool()
+{
+	for (size_t i = 0; i < BUFFER_POOL_CLASSES; i++)
+	{
+		for (char *buffer : _classes[i].cached)
+			delete[] buffer;
+	}
+}
+
+size_t	BufferPool::classIndex(size_t size)
+{
+	size_t index = 0;
+	while (index < BUFFER_POOL_CLASSES - 1 && (static_cast<size_t>(BUFFER_POOL_MIN) << index) < size)
+		index++;
+	return index;
+}
+
+char	*BufferPool::acquire(size_t minSize, size_t &size)
+{
+	SizeClass &sizeClass = _classes[classIndex(minSize)];
+	char *buffer;
+	if (sizeClass.cached.empty())
+		buffer = new char[sizeClass.size];
+	else
+	{
+		buffer = sizeClass.cached.back();
+		sizeClass.cached.pop_back();
+	}
+	sizeClass.inUse++;
+	size = sizeClass.size;
+	return buffer;
+}
+
+void	BufferPool::release(char *buffer, size_t size)
+{
+	SizeClass &sizeClass = _classes[classIndex(size)];
+	sizeClass.inUse--;
+	// Keep enough for the next burst of connections, but let memory go once a flood is over
+	if (sizeClass.cached.size() < BUFFER_POOL_KEEP)
+		sizeClass.cached.push_back(buffer);
+	else
+		delete[] buffer;
+}
+
+size_t	BufferPool::classCount() const
+{
+	return BUFFER_POOL_CLASSES;
+}
+
+BufferPool::Stats	BufferPool::stats(size_t index) const
+{
+	const SizeClass &sizeClass = _classes[index];
+	return Stats{sizeClass.size, sizeClass.inUse, sizeClass.cached.size()};
+}
@@ -0,0 +1,45 @@
+#ifndef BUFFERPOOL_HPP
+# define BUFFERPOOL_HPP
+
+# include <cstddef>
+# include <vector>
+
+# define BUFFER_POOL_MIN 1024 // Smallest size class, holds two maximum length IRC lines
+# define BUFFER_POOL_CLASSES 4 // Powers of two from BUFFER_POOL_MIN, the largest is INPUT_BUFFER_SIZE
+# define BUFFER_POOL_KEEP 64 // Released buffers cached per class, the rest goes back to the heap
+
+class	BufferPool // Size classed free lists for per connection buffers, so connection churn doesn't hit malloc
+{
+	private:
+		struct	SizeClass
+		{
+			size_t				size;
+			size_t				inUse;
+			std::vector<char*>	cached;
+		};
+
+		SizeClass	_classes[BUFFER_POOL_CLASSES];
+
+		static size_t	classIndex(size_t size);
+
+	public:
+		struct	Stats
+		{
+			size_t	size; // Bytes per buffer in this class
+			size_t	inUse;
+			size_t	cached; // Released and kept for reuse
+		};
+
+		BufferPool();
+		~BufferPool();
+
+		BufferPool(BufferPool const &copy) = delete;
+		BufferPool &operator=(BufferPool const &copy) = delete;
+
+		char	*acquire(size_t minSize, size_t &size); // Buffer of the smallest class holding minSize, size gets its real size
+		void	release(char *buffer, size_t size); // size as returned by acquire()
+		size_t	classCount() const;
+		Stats	stats(size_t index) const;
+};
+
+#endif
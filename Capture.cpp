@@ -0,0 +1,108 @@
+#include "Capture.hpp"
+#include "Logger.hpp"
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <stdexcept>
+#include <unistd.h>
+
+static uint64_t	monotonicNs()
+{
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return static_cast<uint64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+static void	putInteger(std::vector<char> &out, uint64_t value, size_t bytes)
+{
+	for (size_t i = 0; i < bytes; i++)
+		out.push_back(static_cast<char>(value >> (8 * i)));
+}
+
+static bool	getInteger(FILE *file, uint64_t &value, size_t bytes)
+{
+	unsigned char raw[8];
+	if (fread(raw, 1, bytes, file) != bytes)
+		return false;
+	value = 0;
+	for (size_t i = 0; i < bytes; i++)
+		value |= static_cast<uint64_t>(raw[i]) << (8 * i);
+	return true;
+}
+
+Capture::Capture() : _fd(-1), _start(0) {}
+
+Capture::~Capture()
+{
+	if (_fd < 0)
+		return;
+	flush();
+	close(_fd);
+}
+
+void	Capture::open(std::string const &path)
+{
+	_fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600); // Holds user traffic, keep it private
+	if (_fd < 0)
+		throw std::runtime_error("Error: Cannot open capture file " + path + ": " + strerror(errno));
+	_start = monotonicNs();
+	_buffer.reserve(CAPTURE_FLUSH_SIZE * 2);
+	_buffer.insert(_buffer.end(), CAPTURE_MAGIC, CAPTURE_MAGIC + strlen(CAPTURE_MAGIC));
+}
+
+void	Capture::record(uint8_t type, uint64_t connection, std::string_view data)
+{
+	_buffer.push_back(static_cast<char>(type));
+	putInteger(_buffer, connection, 8);
+	putInteger(_buffer, monotonicNs() - _start, 8);
+	putInteger(_buffer, data.size(), 4);
+	_buffer.insert(_buffer.end(), data.begin(), data.end());
+	if (_buffer.size() >= CAPTURE_FLUSH_SIZE)
+		flush();
+}
+
+void	Capture::line(uint64_t connection, std::string_view line)
+{
+	if (_fd >= 0)
+		record(CaptureRecord::LINE, connection, Logger::redact(line));
+}
+
+void	Capture::flush()
+{
+	size_t done = 0;
+	while (_fd >= 0 && done < _buffer.size())
+	{
+		ssize_t written = write(_fd, _buffer.data() + done, _buffer.size() - done);
+		if (written < 0 && errno == EINTR)
+			continue;
+		if (written <= 0)
+		{
+			LOG(LOG_ERROR) << "Capture stopped, write failed: " << strerror(errno);
+			close(_fd);
+			_fd = -1;
+			break;
+		}
+		done += written;
+	}
+	_buffer.clear();
+}
+
+bool	Capture::readHeader(FILE *file)
+{
+	char magic[sizeof(CAPTURE_MAGIC) - 1];
+	return fread(magic, 1, sizeof(magic), file) == sizeof(magic) && memcmp(magic, CAPTURE_MAGIC, sizeof(magic)) == 0;
+}
+
+bool	Capture::read(FILE *file, CaptureRecord &record)
+{
+	uint64_t type, length;
+	if (!getInteger(file, type, 1) || !getInteger(file, record.connection, 8)
+		|| !getInteger(file, record.time, 8) || !getInteger(file, length, 4))
+		return false;
+	if (length > CAPTURE_DATA_MAX) // Not written by Capture, don't let the file size the allocation
+		return false;
+	record.type = static_cast<uint8_t>(type);
+	record.data.resize(length);
+	return length == 0 || fread(&record.data[0], 1, length, file) == length;
+}
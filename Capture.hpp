@@ -0,0 +1,65 @@
+#ifndef CAPTURE_HPP
+# define CAPTURE_HPP
+
+# include <cstdint>
+# include <cstdio>
+# include <string>
+# include <string_view>
+# include <vector>
+
+// File layout, integers little endian:
+//   "IRCCAP1\n"
+//   records: u8 type, u64 connection, u64 nanoseconds since the capture started, u32 length, length bytes
+// connection is the client's UserHandle::token(), unique for the whole capture even when fds are reused.
+// PASS arguments are never written, only whether the server accepted them; a replay supplies its own password
+# define CAPTURE_MAGIC "IRCCAP1\n"
+# define CAPTURE_PASS_ACCEPTED "PASS <redacted>"
+# define CAPTURE_PASS_REJECTED "PASS <rejected>"
+# define CAPTURE_DATA_MAX 512 // Longest record data read(), recorded lines are shorter than IRC_LINE_MAX
+# define CAPTURE_FLUSH_SIZE (64 * 1024) // Buffered bytes that force a write before the end of the loop iteration
+
+struct	CaptureRecord
+{
+	enum	Type
+	{
+		CONNECT = 1,
+		LINE = 2, // One inbound line without its CR-LF
+		DISCONNECT = 3
+	};
+
+	uint8_t		type;
+	uint64_t	connection;
+	uint64_t	time; // Nanoseconds, monotonic
+	std::string	data;
+};
+
+class	Capture // Records inbound traffic for bench/replay.cpp. Cheap when disabled: every call is one branch
+{
+	private:
+		int					_fd; // -1 while disabled
+		uint64_t			_start; // Monotonic time of open()
+		std::vector<char>	_buffer;
+
+		void	record(uint8_t type, uint64_t connection, std::string_view data);
+
+	public:
+		Capture();
+		~Capture(); // Writes what is buffered
+
+		Capture(Capture const &copy) = delete;
+		Capture &operator=(Capture const &copy) = delete;
+
+		void	open(std::string const &path); // Throws when the file can't be created
+		bool	enabled() const { return _fd >= 0; }
+
+		void	connected(uint64_t connection) { if (_fd >= 0) record(CaptureRecord::CONNECT, connection, ""); }
+		void	line(uint64_t connection, std::string_view line);
+		void	password(uint64_t connection, bool accepted) { if (_fd >= 0) record(CaptureRecord::LINE, connection, accepted ? CAPTURE_PASS_ACCEPTED : CAPTURE_PASS_REJECTED); }
+		void	disconnected(uint64_t connection) { if (_fd >= 0) record(CaptureRecord::DISCONNECT, connection, ""); }
+		void	flush(); // Called once per loop iteration
+
+		static bool	read(FILE *file, CaptureRecord &record); // Next record of a capture file, false at its end or a malformed record
+		static bool	readHeader(FILE *file);
+};
+
+#endif
@@ -12,82 +12,162 @@
 
 #include "Channel.hpp"
 #include "User.hpp"
+#include <algorithm>
 
-Channel::Channel(const std::string& name) : _name(name) {}
+Channel::Channel(const std::string& name, const ClientTable& clients) : _name(name), _clients(clients) {}
 
-Channel::~Channel(void) {}
+Channel::~Channel(void)
+{
+    for (const Entry& entry : _entries)
+    {
+        User* user = _clients.get(entry.user);
+        if (user)
+            user->removeChannel(this);
+    }
+}
+
+// position of slot in _entries, or where it would be inserted
+size_t Channel::lowerBound(uint32_t slot) const
+{
+    auto it = std::lower_bound(_entries.begin(), _entries.end(), slot,
+        [](const Entry& entry, uint32_t value) { return entry.user.slot < value; });
+    return it - _entries.begin();
+}
+
+Channel::Entry* Channel::findEntry(const User& user)
+{
+    UserHandle handle = user.getHandle();
+    size_t i = lowerBound(handle.slot);
+    if (i == _entries.size() || _entries[i].user != handle)
+        return nullptr;
+    return &_entries[i];
+}
+
+Channel::Entry& Channel::insertEntry(User& user)
+{
+    UserHandle handle = user.getHandle();
+    size_t i = lowerBound(handle.slot);
+    if (i < _entries.size() && _entries[i].user == handle)
+        return _entries[i];
+    user.addChannel(this); // the user's channel list mirrors every entry, so disconnects clear invitations too
+    return *_entries.insert(_entries.begin() + i, Entry{handle, 0});
+}
+
+uint32_t Channel::flagsOf(const User& user) const
+{
+    UserHandle handle = user.getHandle();
+    size_t i = lowerBound(handle.slot);
+    if (i == _entries.size() || _entries[i].user != handle)
+        return 0;
+    return _entries[i].flags;
+}
+
+void Channel::setFlag(User& user, uint32_t flag, bool enable)
+{
+    if (enable)
+        insertEntry(user).flags |= flag;
+    else if (Entry* entry = findEntry(user))
+        entry->flags &= ~flag;
+}
 
-bool Channel::addUser(std::shared_ptr<User> user, const std::string& providedKey) 
+bool Channel::addUser(User& user, const std::string& providedKey) 
 {
-    const std::string& nick = user->getNickname();
+    uint32_t flags = flagsOf(user);
 
-    if (_inviteOnly && !isInvited(nick))
+    if (flags & MEMBER)
+        return true;
+
+    if (_inviteOnly && !(flags & INVITED))
         return false;
 
     if (_hasKey && providedKey != _key)
         return false;
 
-    if (_hasUserLimit && _users.size() >= _userLimit)
+    if (_hasUserLimit && _memberCount >= _userLimit)
         return false;
 
-    _users[nick] = user;
-    _invited.erase(nick);
+    Entry& entry = insertEntry(user);
+    entry.flags = (entry.flags | MEMBER) & ~INVITED;
+    _memberCount++;
+    _namesValid = false;
     // removing broadcast here, server will handle JOIN messages
 
     return true;
 }
 
-void Channel::removeUser(const std::string& nickname)
+void Channel::removeUser(User& user)
 {
-    _users.erase(nickname);
-    _operators.erase(nickname);
+    Entry* entry = findEntry(user);
+    if (!entry)
+        return;
+    if (entry->flags & MEMBER)
+    {
+        _memberCount--;
+        _namesValid = false;
+    }
+    _entries.erase(_entries.begin() + (entry - _entries.data()));
+    user.removeChannel(this);
     // removing broadcast here, server will handle PART/QUIT messages
 }
 
-bool	Channel::hasUser(const std::string& nickname) const
+bool	Channel::hasMember(const User& user) const
 {
-	return _users.count(nickname) > 0;
+	return flagsOf(user) & MEMBER;
 }
 
-void Channel::addOperator(const std::string& nickname)
+size_t	Channel::size(void) const
 {
-    if (_users.count(nickname)) {
-        _operators.insert(nickname);
-    }
+	return _memberCount;
+}
+
+bool	Channel::empty(void) const
+{
+	return _memberCount == 0;
+}
+
+void Channel::setOperator(User& user, bool enable)
+{
+    if (!hasMember(user))
+        return;
+    setFlag(user, OPERATOR, enable);
+    _namesValid = false;
 }
 
-void Channel::removeOperator(const std::string& nickname)
+bool Channel::isOperator(const User& user) const 
 {
-    _operators.erase(nickname);
+    return flagsOf(user) & OPERATOR;
 }
 
-bool Channel::isOperator(const std::string& nickname) const 
+void Channel::setVoice(User& user, bool enable)
 {
-    return _operators.count(nickname);
+    if (!hasMember(user))
+        return;
+    setFlag(user, VOICE, enable);
+    _namesValid = false;
 }
 
-void Channel::setTopic(const std::string& nickname, const std::string& newTopic)
+void Channel::setTopic(const User& by, const std::string& newTopic)
 {
-    if (_topicRestricted && !isOperator(nickname)) return;
+    if (_topicRestricted && !isOperator(by)) return;
     _topic = newTopic;
     // removing broadcast here, server will handle TOPIC messages
 }
 
-std::string Channel::getTopic(void) const
+const std::string& Channel::getTopic(void) const
 {
     return _topic;
 }
 
-void Channel::inviteUser(const std::string& by, const std::string& target) 
+void Channel::inviteUser(const User& by, User& target) 
 {
-    if (isOperator(by)) {
-        _invited.insert(target);
+    if (isOperator(by) && !hasMember(target)) {
+        setFlag(target, INVITED, true);
     }
 }
 
-bool Channel::isInvited(const std::string& nickname) const
+bool Channel::isInvited(const User& user) const
 {
-    return _invited.count(nickname);
+    return flagsOf(user) & INVITED;
 }
 
 void Channel::setMode(char mode, bool enable, const std::string& arg) 
@@ -117,36 +197,51 @@ void Channel::setMode(char mode, bool enable, const std::string& arg)
                 _userLimit = 0;
             }
             break;
-       case 'o':
-            if (!arg.empty()) {
-                if (enable)
-                    addOperator(arg);
-                else
-                    removeOperator(arg);
-            }
-            break;
         default:
             break;
     }
 }
- 
-void Channel::broadcast(const std::string& message, const std::string& excludeNick)
+
+void Channel::broadcast(const std::string& message, const User* exclude)
 {
-    for (auto& [nick, user] : _users) {
-        if (excludeNick.empty() || nick != excludeNick)
-        {
-            user->sendMessage(message);
-        }
-    }
+    // serialize once, every member queues the same buffer
+    SharedLine line = makeSharedLine(message);
+    forEachMember([&](User& user, uint32_t) {
+        if (&user != exclude)
+            user.sendLine(line);
+    });
 }
 
-std::string Channel::getName(void) const
+const std::string& Channel::getName(void) const
 {
     return _name;
 }
 
-// used by server to get users in channel for LIST command
-std::unordered_map<std::string, std::shared_ptr<User>> Channel::getUsers(void) const
+// shared by every JOIN and NAMES until membership or operator status changes
+const std::vector<std::string>& Channel::getNamesReply(void) const
 {
-    return _users;
+    if (_namesValid)
+        return _namesReply;
+
+    size_t budget = 512 - NAMES_LINE_OVERHEAD - _name.size();
+    _namesReply.clear();
+    std::string line;
+    forEachMember([&](User& user, uint32_t flags) {
+        const std::string& nick = user.getNickname();
+        const char* prefix = (flags & OPERATOR) ? "@" : (flags & VOICE) ? "+" : "";
+        size_t entry = nick.size() + (*prefix ? 1 : 0);
+        if (!line.empty() && line.size() + 1 + entry > budget)
+        {
+            _namesReply.push_back(line);
+            line.clear();
+        }
+        if (!line.empty())
+            line += " ";
+        line += prefix;
+        line += nick;
+    });
+    if (!line.empty())
+        _namesReply.push_back(line);
+    _namesValid = true;
+    return _namesReply;
 }
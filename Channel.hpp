@@ -9,20 +9,39 @@
 /*   Updated: 2025/06/06 16:00:06 by nmeintje         ###   ########.fr       */
 /*                                                                            */
 /* ************************************************************************** */
-
 #pragma once
 
 #include <string>
-#include <unordered_map>
-#include <unordered_set>
+#include <cstdint>
 #include <memory>
 #include <iostream>
+#include <vector>
+#include "UserHandle.hpp"
+
+// ":irc.server.com 353 " + 9 char nick + " = " + " :" + CRLF around the channel name and the names
+#define NAMES_LINE_OVERHEAD 36
 
 class User;
+class ClientTable;
 
 class Channel {
 
+	public:
+		// per user flag bits, one word per entry
+		enum
+		{
+			MEMBER = 1,   // joined
+			OPERATOR = 2, // +o
+			VOICE = 4,    // +v
+			INVITED = 8   // may join while +i
+		};
+
 	private:
+		struct Entry // 12 bytes: a hundred users fit in 19 cache lines
+		{
+			UserHandle user;
+			uint32_t   flags;
+		};
 		
 		std::string _name;
 		std::string _topic;
@@ -33,39 +52,70 @@ class Channel {
 		bool _inviteOnly = false;
 		bool _topicRestricted = false;
 
-		std::unordered_map<std::string, std::shared_ptr<User>>  _users;
-		std::unordered_set<std::string>                         _operators;
-		std::unordered_set<std::string>                         _invited;
+		const ClientTable&  _clients;     // resolves entry handles back to users
+		std::vector<Entry>  _entries;     // sorted by slot, members and invited users alike
+		size_t              _memberCount = 0;
+
+		// 353 payloads ("@nick nick ...") split to fit a 512 byte line, rebuilt lazily after membership or op changes
+		mutable std::vector<std::string>                        _namesReply;
+		mutable bool                                            _namesValid = false;
+
+		size_t			lowerBound(uint32_t slot) const;
+		Entry*			findEntry(const User& user);
+		Entry&			insertEntry(User& user);
+		uint32_t		flagsOf(const User& user) const;
+		void			setFlag(User& user, uint32_t flag, bool enable);
 		
 	public:
 		//constructors and destructor
 		Channel(void) = delete;
 		Channel(const Channel& copy) = delete;
-		Channel(const std::string& name);
+		Channel(const std::string& name, const ClientTable& clients);
 		Channel &operator=(const Channel& other) = delete;
 		~Channel(void);
 
 		//add or remove user
-		bool addUser(std::shared_ptr<User> user, const std::string& providedKey = "");
-		void removeUser(const std::string& nickname);
-		bool	hasUser(const std::string& nickname) const;
+		bool addUser(User& user, const std::string& providedKey = "");
+		void removeUser(User& user); // drops every flag, invitation included
+		bool	hasMember(const User& user) const;
+		size_t	size(void) const;
+		bool	empty(void) const;
+
+		// calls visit(user, flags) for every member, in slot order
+		template <typename Visitor>
+		void	forEachMember(Visitor visit) const;
 
-		// methods related to operators
-		void addOperator(const std::string& nickname);
-		void removeOperator(const std::string& nickname);
-		bool isOperator(const std::string& nickname) const;
+		// methods related to operators and voice
+		void setOperator(User& user, bool enable);
+		bool isOperator(const User& user) const;
+		void setVoice(User& user, bool enable);
 
 		// Channel topics
-		void setTopic(const std::string& nickname, const std::string& newTopic);
-		std::string getTopic(void) const;
+		void setTopic(const User& by, const std::string& newTopic);
+		const std::string& getTopic(void) const;
 
 		// for if channel is invite only/private
-		void inviteUser(const std::string& by, const std::string& target);
-		bool isInvited(const std::string& nickname) const;
+		void inviteUser(const User& by, User& target);
+		bool isInvited(const User& user) const;
 
-		void setMode(char mode, bool enable, const std::string& arg = "");
-		void broadcast(const std::string& message, const std::string& excludeNick = "");
-		std::string getName(void) const;
-		std::unordered_map<std::string, std::shared_ptr<User>> getUsers(void) const;
+		void setMode(char mode, bool enable, const std::string& arg = ""); // i, t, k and l; o and v take a user, see setOperator/setVoice
+		void broadcast(const std::string& message, const User* exclude = nullptr);
+		const std::string& getName(void) const;
+		const std::vector<std::string>& getNamesReply(void) const;
 
 };
+
+#include "ClientTable.hpp"
+
+template <typename Visitor>
+void	Channel::forEachMember(Visitor visit) const
+{
+	for (const Entry& entry : _entries)
+	{
+		if (!(entry.flags & MEMBER))
+			continue;
+		User* user = _clients.get(entry.user);
+		if (user)
+			visit(*user, entry.flags);
+	}
+}
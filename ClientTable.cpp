@@ -0,0 +1,63 @@
+#include "ClientTable.hpp"
+#include <stdexcept>
+#include <string>
+
+ClientTable::ClientTable() : _count(0) {}
+
+ClientTable::~ClientTable()
+{
+	for (Slot &slot : _slots)
+		_pool.destroy(slot.user);
+}
+
+UserHandle	ClientTable::insert(User *user)
+{
+	int fd = user->getSocket();
+	if (static_cast<size_t>(fd) >= _slots.size())
+		_slots.resize(fd + 1);
+
+	Slot &slot = _slots[fd];
+	if (slot.user)
+	{
+		// The kernel reuses an fd only once it is closed, which happens after erase(). The old owner is still named by
+		// channels and the nick index, replacing it would leave them dangling
+		_pool.destroy(user);
+		throw std::logic_error("ClientTable: fd " + std::to_string(fd) + " is still owned by a connected client");
+	}
+	_count++;
+
+	UserHandle handle = {static_cast<uint32_t>(fd), slot.generation};
+	user->setHandle(handle);
+	slot.user = user;
+	return handle;
+}
+
+User	*ClientTable::get(UserHandle handle) const
+{
+	if (handle.slot >= _slots.size() || _slots[handle.slot].generation != handle.generation)
+		return nullptr;
+	return _slots[handle.slot].user;
+}
+
+void	ClientTable::erase(UserHandle handle)
+{
+	User *user = get(handle);
+	if (!user)
+		return;
+
+	Slot &slot = _slots[handle.slot];
+	_pool.destroy(user);
+	slot.user = nullptr;
+	slot.generation++;
+	_count--;
+}
+
+size_t	ClientTable::size() const
+{
+	return _count;
+}
+
+const ObjectPool<User>	&ClientTable::pool() const
+{
+	return _pool;
+}
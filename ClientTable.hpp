@@ -0,0 +1,61 @@
+#ifndef CLIENTTABLE_HPP
+# define CLIENTTABLE_HPP
+
+# include <vector>
+# include <utility>
+# include "User.hpp"
+# include "UserHandle.hpp"
+# include "ObjectPool.hpp"
+
+class	ClientTable // Owns the connected clients. Slot table indexed by socket fd: O(1) lookup, insert and removal
+{
+	private:
+		struct	Slot
+		{
+			User		*user = nullptr; // Lives in _pool, null while the slot is free
+			uint32_t	generation = 1;
+		};
+
+		ObjectPool<User>	_pool;
+		std::vector<Slot>	_slots; // The kernel hands out low fds first, so this stays small
+		size_t				_count;
+
+		UserHandle	insert(User *user);
+
+	public:
+		ClientTable();
+		~ClientTable();
+
+		ClientTable(ClientTable const &copy) = delete;
+		ClientTable &operator=(ClientTable const &copy) = delete;
+
+		template <typename... Args>
+		User		&emplace(Args&&... args); // Builds a User in the pool, takes the slot of its socket and stamps the handle on it. Throws std::logic_error if that slot is taken
+		User		*get(UserHandle handle) const; // nullptr when the client behind handle has disconnected
+		void		erase(UserHandle handle); // Destroys the user, handles to it go stale
+		size_t		size() const;
+		const ObjectPool<User>	&pool() const;
+
+		template <typename Visitor>
+		void		forEach(Visitor visit) const; // visit(User&) for every client, in fd order
+};
+
+template <typename... Args>
+User	&ClientTable::emplace(Args&&... args)
+{
+	User *user = _pool.create(std::forward<Args>(args)...);
+	insert(user);
+	return *user;
+}
+
+template <typename Visitor>
+void	ClientTable::forEach(Visitor visit) const
+{
+	for (const Slot &slot : _slots)
+	{
+		if (slot.user)
+			visit(*slot.user);
+	}
+}
+
+#endif
@@ -0,0 +1,76 @@
+#include "EpollPoller.hpp"
+#include <cerrno>
+#include <stdexcept>
+#include <unistd.h>
+
+EpollPoller::EpollPoller() : _epoll_fd(epoll_create1(EPOLL_CLOEXEC)), _ready(64)
+{
+	if (_epoll_fd < 0)
+		throw std::runtime_error("Error: Failed to create epoll instance.");
+}
+
+EpollPoller::~EpollPoller()
+{
+	close(_epoll_fd);
+}
+
+void	EpollPoller::control(int op, int fd, uint32_t interest, uint64_t token)
+{
+	struct epoll_event ev = {};
+	ev.events = EPOLLET | EPOLLRDHUP; // Edge triggered: the server drains a fd until EAGAIN once it is reported
+	if (interest & READ)
+		ev.events |= EPOLLIN;
+	if (interest & WRITE)
+		ev.events |= EPOLLOUT;
+	ev.data.u64 = token;
+	if (epoll_ctl(_epoll_fd, op, fd, &ev) < 0)
+		throw std::runtime_error("Error: epoll_ctl failed.");
+}
+
+void	EpollPoller::add(int fd, uint32_t interest, uint64_t token)
+{
+	control(EPOLL_CTL_ADD, fd, interest, token);
+}
+
+void	EpollPoller::modify(int fd, uint32_t interest, uint64_t token)
+{
+	control(EPOLL_CTL_MOD, fd, interest, token);
+}
+
+void	EpollPoller::remove(int fd)
+{
+	epoll_ctl(_epoll_fd, EPOLL_CTL_DEL, fd, nullptr); // fd may already be gone, nothing to report
+}
+
+int	EpollPoller::wait(std::vector<PollEvent> &events, int timeout_ms)
+{
+	events.clear();
+	int ret = epoll_wait(_epoll_fd, _ready.data(), _ready.size(), timeout_ms);
+	if (ret < 0)
+	{
+		if (errno == EINTR)
+			return 0;
+		throw std::runtime_error("Error: epoll_wait failed.");
+	}
+
+	for (int i = 0; i < ret; ++i)
+	{
+		uint32_t revents = _ready[i].events;
+		uint32_t ready = 0;
+		if (revents & (EPOLLIN | EPOLLRDHUP))
+			ready |= READ;
+		if (revents & EPOLLOUT)
+			ready |= WRITE;
+		if (revents & (EPOLLERR | EPOLLHUP))
+			ready |= ERROR;
+		events.push_back({_ready[i].data.u64, ready});
+	}
+	if (static_cast<size_t>(ret) == _ready.size())
+		_ready.resize(_ready.size() * 2); // More fds were probably ready, take a bigger bite next time
+	return ret;
+}
+
+const char	*EpollPoller::name() const
+{
+	return "epoll";
+}
@@ -0,0 +1,30 @@
+#ifndef EPOLLPOLLER_HPP
+# define EPOLLPOLLER_HPP
+
+# include <vector>
+# include <sys/epoll.h>
+# include "Poller.hpp"
+
+class	EpollPoller : public Poller // Linux edge triggered backend, cost per wakeup is O(ready fds) instead of O(all fds)
+{
+	private:
+		int								_epoll_fd;
+		std::vector<struct epoll_event>	_ready; // Scratch array for epoll_wait(), grows when it comes back full
+
+		EpollPoller(EpollPoller const &copy) = delete;
+		EpollPoller &operator=(EpollPoller const &copy) = delete;
+
+		void	control(int op, int fd, uint32_t interest, uint64_t token);
+
+	public:
+		EpollPoller();
+		~EpollPoller();
+
+		void		add(int fd, uint32_t interest, uint64_t token);
+		void		modify(int fd, uint32_t interest, uint64_t token);
+		void		remove(int fd);
+		int			wait(std::vector<PollEvent> &events, int timeout_ms);
+		const char	*name() const;
+};
+
+#endif
@@ -0,0 +1,128 @@
+#include "InputBuffer.hpp"
+#include <cstring>
+
+InputBuffer::InputBuffer(BufferPool &pool) : _pool(pool), _data(nullptr), _capacity(0), _wanted(BUFFER_POOL_MIN), _start(0), _scan(0), _end(0), _last(0), _discarding(false) {}
+
+InputBuffer::~InputBuffer()
+{
+	if (_data)
+		_pool.release(_data, _capacity);
+}
+
+void	InputBuffer::compact()
+{
+	// Move the partial line to the front, it is never longer than IRC_LINE_MAX so this stays cheap
+	if (_start == 0)
+		return;
+	std::memmove(_data, _data + _start, _end - _start);
+	_scan -= _start;
+	_end -= _start;
+	_start = 0;
+}
+
+void	InputBuffer::reserve()
+{
+	size_t capacity = 0;
+	char *data = _pool.acquire(_wanted, capacity);
+	if (_data)
+	{
+		std::memcpy(data, _data + _start, _end - _start);
+		_pool.release(_data, _capacity);
+	}
+	_scan -= _start;
+	_end -= _start;
+	_start = 0;
+	_data = data;
+	_capacity = capacity;
+}
+
+char	*InputBuffer::writeSpace(size_t &len)
+{
+	if (_capacity < _wanted)
+		reserve();
+	else if (_end == _capacity)
+		compact();
+	len = _capacity - _end;
+	return _data + _end;
+}
+
+void	InputBuffer::commit(size_t len)
+{
+	_end += len;
+	// A read that filled the buffer means more is waiting, take a bigger one next time (kept until release())
+	if (_end == _capacity && _wanted < INPUT_BUFFER_SIZE)
+		_wanted = _capacity * 2;
+}
+
+InputBuffer::Frame	InputBuffer::nextLine(std::string_view &line)
+{
+	if (!_data)
+		return NONE;
+	while (true)
+	{
+		// Only look at bytes that weren't searched yet, a line trickling in byte by byte stays O(n)
+		const char *base = _data;
+		const char *newline = static_cast<const char *>(std::memchr(base + _scan, '\n', _end - _scan));
+		if (!newline)
+		{
+			_scan = _end;
+			if (_discarding)
+			{
+				_start = _scan = _end = 0; // Nothing worth keeping
+				return NONE;
+			}
+			if (_end - _start >= IRC_LINE_MAX) // No newline within the limit, drop until the next one
+			{
+				_discarding = true;
+				_start = _scan = _end = 0;
+				return TOO_LONG;
+			}
+			if (_start == _end)
+				_start = _scan = _end = 0;
+			return NONE;
+		}
+
+		size_t lineStart = _start;
+		size_t lineEnd = newline - base; // Position of '\n'
+		_start = _scan = lineEnd + 1;
+		if (_discarding) // Tail of a line that was already reported, skip it
+		{
+			_discarding = false;
+			continue;
+		}
+		if (lineEnd + 1 - lineStart > IRC_LINE_MAX)
+			return TOO_LONG;
+
+		if (lineEnd > lineStart && base[lineEnd - 1] == '\r')
+			lineEnd--;
+		line = std::string_view(base + lineStart, lineEnd - lineStart);
+		_last = lineStart;
+		return LINE;
+	}
+}
+
+void	InputBuffer::putBack()
+{
+	_start = _scan = _last; // Searched again, at most one line
+}
+
+size_t	InputBuffer::size() const
+{
+	return _end - _start;
+}
+
+size_t	InputBuffer::capacity() const
+{
+	return _capacity;
+}
+
+void	InputBuffer::release()
+{
+	if (!_data || _start != _end)
+		return;
+	_pool.release(_data, _capacity);
+	_data = nullptr;
+	_capacity = 0;
+	_wanted = BUFFER_POOL_MIN;
+	_start = _scan = _end = 0;
+}
@@ -0,0 +1,50 @@
+#ifndef INPUTBUFFER_HPP
+# define INPUTBUFFER_HPP
+
+# include <cstddef>
+# include <string_view>
+# include "BufferPool.hpp"
+
+# define INPUT_BUFFER_SIZE 8192 // Most bytes of not yet framed input a connection can hold
+# define IRC_LINE_MAX 512 // Longest message allowed by RFC 1459, CR-LF included
+
+class	InputBuffer // Per connection buffer that frames incoming bytes into IRC lines, storage comes from a BufferPool
+{
+	private:
+		BufferPool				&_pool;
+		char					*_data; // nullptr while idle, see release()
+		size_t					_capacity;
+		size_t					_wanted; // Size class for the next buffer, doubles whenever a read fills the current one
+		size_t					_start; // First byte of the next line
+		size_t					_scan; // Bytes before this position were already searched for a newline
+		size_t					_end; // One past the last received byte
+		size_t					_last; // Start of the line nextLine() returned last, see putBack()
+		bool					_discarding; // Dropping the rest of an overlong line until its newline shows up
+
+		void	compact();
+		void	reserve(); // Takes a buffer of _wanted bytes, keeping what is buffered
+
+	public:
+		enum	Frame
+		{
+			NONE, // No complete line yet
+			LINE, // line holds the next message, without its CR-LF
+			TOO_LONG // An overlong line was dropped
+		};
+
+		explicit InputBuffer(BufferPool &pool);
+		~InputBuffer();
+
+		InputBuffer(InputBuffer const &copy) = delete;
+		InputBuffer &operator=(InputBuffer const &copy) = delete;
+
+		char	*writeSpace(size_t &len); // Free space at the end, for recv() to fill directly
+		void	commit(size_t len); // len bytes were written into writeSpace()
+		Frame	nextLine(std::string_view &line); // line points into the buffer and stays valid until the next writeSpace()
+		void	putBack(); // Unframes the line nextLine() just returned, the next call returns it again
+		size_t	size() const; // Bytes received but not framed yet
+		size_t	capacity() const; // 0 while idle
+		void	release(); // Hands the storage back to the pool if nothing is buffered, writeSpace() takes a new one
+};
+
+#endif
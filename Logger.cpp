@@ -0,0 +1,181 @@
+#include "Logger.hpp"
+#include <cstdio>
+#include <cstring>
+#include <strings.h>
+#include <cerrno>
+#include <chrono>
+#include <unistd.h>
+
+std::unique_ptr<Logger::Record[]>	Logger::_ring;
+std::atomic<size_t>					Logger::_head(0);
+std::atomic<size_t>					Logger::_tail(0);
+std::atomic<size_t>					Logger::_dropped(0);
+std::atomic<int>					Logger::_threshold(LOG_OFF);
+std::atomic<bool>					Logger::_running(false);
+std::atomic<bool>					Logger::_sleeping(false);
+std::mutex							Logger::_mutex;
+std::condition_variable				Logger::_wakeup;
+std::thread							Logger::_writer;
+
+static const char	*LEVEL_NAMES[] = {"DEBUG", "INFO ", "WARN ", "ERROR"};
+
+Logger::Line::Line(LogLevel level) : _record(nullptr)
+{
+	size_t tail = _tail.load(std::memory_order_relaxed);
+	if (tail - _head.load(std::memory_order_acquire) == LOG_RING_SIZE)
+	{
+		_dropped.fetch_add(1, std::memory_order_relaxed); // Never block the event loop on logging
+		return;
+	}
+	_record = &_ring[tail & (LOG_RING_SIZE - 1)];
+	clock_gettime(CLOCK_REALTIME, &_record->time); // vDSO, no syscall
+	_record->level = level;
+	_record->length = 0;
+}
+
+Logger::Line::~Line()
+{
+	if (!_record)
+		return;
+	_tail.store(_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	if (_sleeping.load())
+	{
+		_sleeping.store(false);
+		_wakeup.notify_one();
+	}
+}
+
+Logger::Line	&Logger::Line::operator<<(std::string_view text)
+{
+	if (!_record)
+		return *this;
+	size_t room = LOG_RECORD_MAX - _record->length;
+	size_t len = text.size() < room ? text.size() : room;
+	std::memcpy(_record->text + _record->length, text.data(), len);
+	_record->length += len;
+	return *this;
+}
+
+Logger::Line	&Logger::Line::operator<<(char c)
+{
+	return *this << std::string_view(&c, 1);
+}
+
+bool	Logger::drain(std::string &out)
+{
+	size_t head = _head.load(std::memory_order_relaxed);
+	size_t tail = _tail.load(std::memory_order_acquire);
+	if (head == tail)
+		return false;
+
+	for (; head != tail; head++)
+	{
+		const Record &record = _ring[head & (LOG_RING_SIZE - 1)];
+		struct tm local;
+		localtime_r(&record.time.tv_sec, &local);
+		char stamp[48];
+		size_t len = strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &local);
+		snprintf(stamp + len, sizeof(stamp) - len, ".%03ld ", record.time.tv_nsec / 1000000);
+		out += stamp;
+		out += LEVEL_NAMES[record.level];
+		out += ' ';
+		out.append(record.text, record.length);
+		out += '\n';
+	}
+	_head.store(head, std::memory_order_release); // Slots may be reused from here on
+	return true;
+}
+
+void	Logger::writerLoop()
+{
+	std::string out;
+	size_t reported = 0;
+	while (true)
+	{
+		bool running = _running.load();
+		out.clear();
+		drain(out);
+		size_t dropped = _dropped.load(std::memory_order_relaxed);
+		if (dropped != reported)
+		{
+			out += "log: " + std::to_string(dropped - reported) + " messages dropped, the writer fell behind\n";
+			reported = dropped;
+		}
+
+		for (size_t done = 0; done < out.size(); )
+		{
+			ssize_t written = write(STDOUT_FILENO, out.data() + done, out.size() - done);
+			if (written < 0 && errno == EINTR)
+				continue;
+			if (written <= 0)
+				break;
+			done += written;
+		}
+		if (!out.empty())
+			continue;
+		if (!running)
+			return;
+
+		// Sleep until the producer finds _sleeping set; the timeout covers a wakeup racing with the check
+		std::unique_lock<std::mutex> lock(_mutex);
+		_sleeping.store(true);
+		if (_head.load() == _tail.load() && _running.load())
+			_wakeup.wait_for(lock, std::chrono::milliseconds(100));
+		_sleeping.store(false);
+	}
+}
+
+void	Logger::start(LogLevel level)
+{
+	if (_running.load())
+		return;
+	_ring.reset(new Record[LOG_RING_SIZE]);
+	_running.store(true);
+	_writer = std::thread(&Logger::writerLoop);
+	_threshold.store(level, std::memory_order_relaxed);
+}
+
+void	Logger::stop()
+{
+	if (!_running.load())
+		return;
+	_threshold.store(LOG_OFF, std::memory_order_relaxed);
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_running.store(false);
+	}
+	_wakeup.notify_one();
+	_writer.join();
+}
+
+bool	Logger::parseLevel(std::string const &name, LogLevel &level)
+{
+	static const char	*names[] = {"debug", "info", "warn", "error", "off"};
+	for (int i = LOG_DEBUG; i <= LOG_OFF; i++)
+	{
+		if (name == names[i])
+		{
+			level = static_cast<LogLevel>(i);
+			return true;
+		}
+	}
+	return false;
+}
+
+std::string_view	Logger::redact(std::string_view line)
+{
+	// Skip an optional prefix, then compare the command case insensitively
+	size_t pos = 0;
+	if (!line.empty() && line[0] == ':')
+	{
+		pos = line.find(' ');
+		if (pos == std::string_view::npos)
+			return line;
+		pos++;
+	}
+	std::string_view command = line.substr(pos, 4);
+	if (command.size() == 4 && strncasecmp(command.data(), "PASS", 4) == 0
+		&& (line.size() == pos + 4 || line[pos + 4] == ' '))
+		return "PASS <redacted>";
+	return line;
+}
@@ -0,0 +1,92 @@
+#ifndef LOGGER_HPP
+# define LOGGER_HPP
+
+# include <atomic>
+# include <charconv>
+# include <condition_variable>
+# include <cstdint>
+# include <ctime>
+# include <memory>
+# include <mutex>
+# include <string>
+# include <string_view>
+# include <thread>
+# include <type_traits>
+
+# define LOG_RING_SIZE 1024 // Records in flight between the event loop and the writer thread, a power of two
+# define LOG_RECORD_MAX 600 // Message bytes per record, longer messages are cut
+
+enum	LogLevel
+{
+	LOG_DEBUG,
+	LOG_INFO,
+	LOG_WARN,
+	LOG_ERROR,
+	LOG_OFF
+};
+
+// LOG(LOG_INFO) << "text " << 42;
+// A disabled level costs one comparison, the message isn't built at all
+# define LOG(level) if ((level) < Logger::threshold()) ; else Logger::Line(level)
+
+class	Logger // Asynchronous log: the event loop copies messages into a ring, a background thread stamps and writes them
+{
+	private:
+		struct	Record
+		{
+			timespec	time;
+			uint8_t		level;
+			uint16_t	length;
+			char		text[LOG_RECORD_MAX];
+		};
+
+		// Single producer (the thread running the event loop), single consumer (the writer thread): no locks on the
+		// producer side, _tail is only written by the producer and _head only by the consumer
+		static std::unique_ptr<Record[]>	_ring;
+		static std::atomic<size_t>			_head;
+		static std::atomic<size_t>			_tail;
+		static std::atomic<size_t>			_dropped; // Records lost to a full ring, reported by the writer
+		static std::atomic<int>				_threshold;
+		static std::atomic<bool>			_running;
+		static std::atomic<bool>			_sleeping; // Writer is (about to be) blocked, the producer wakes it
+		static std::mutex					_mutex; // Only guards the writer's sleep
+		static std::condition_variable		_wakeup;
+		static std::thread					_writer;
+
+		static void	writerLoop();
+		static bool	drain(std::string &out);
+
+	public:
+		class	Line // One message, built in place in the ring and published when it goes out of scope
+		{
+			private:
+				Record	*_record; // nullptr when the ring was full
+
+				Line(Line const &copy) = delete;
+				Line &operator=(Line const &copy) = delete;
+
+			public:
+				explicit Line(LogLevel level);
+				~Line();
+
+				Line	&operator<<(std::string_view text);
+				Line	&operator<<(char c);
+
+				template <typename Integer, typename = typename std::enable_if<std::is_integral<Integer>::value>::type>
+				Line	&operator<<(Integer value)
+				{
+					char digits[24];
+					std::to_chars_result result = std::to_chars(digits, digits + sizeof(digits), value);
+					return *this << std::string_view(digits, result.ptr - digits);
+				}
+		};
+
+		static void				start(LogLevel level); // Spawns the writer, nothing is logged before
+		static void				stop(); // Writes what is left and joins the writer
+		static bool				parseLevel(std::string const &name, LogLevel &level);
+		static std::string_view	redact(std::string_view line); // Hides the password of a PASS line
+
+		static int	threshold() { return _threshold.load(std::memory_order_relaxed); }
+};
+
+#endif
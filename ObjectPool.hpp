@@ -0,0 +1,134 @@
+#ifndef OBJECTPOOL_HPP
+# define OBJECTPOOL_HPP
+
+# include <cstddef>
+# include <cstdint>
+# include <new>
+# include <utility>
+# include <vector>
+
+# define OBJECT_POOL_SLAB 64 // Objects per slab, one bit each in the slab's free mask
+
+template <typename T>
+class	ObjectPool // Slab allocator: objects live in fixed size slabs and never move, a free slot is a bit in the slab's mask
+{
+	private:
+		struct	Slab;
+
+		struct	Cell
+		{
+			Slab			*slab; // Owner, so destroy() finds its slab in O(1)
+			alignas(T) unsigned char	storage[sizeof(T)];
+		};
+
+		struct	Slab
+		{
+			Cell		cells[OBJECT_POOL_SLAB];
+			uint64_t	freeMask; // Bit i set when cells[i] is free
+			size_t		live;
+		};
+
+		std::vector<Slab*>	_slabs;
+		size_t				_hint; // Index of the slab the last object came from
+		Slab				*_spare; // One empty slab kept around, so a connection flapping at a slab boundary doesn't allocate every time
+		size_t				_live;
+
+		Slab	*slabWithRoom();
+		void	freeSlab(Slab *slab);
+
+	public:
+		ObjectPool() : _hint(0), _spare(nullptr), _live(0) {}
+		~ObjectPool(); // Every object must have been destroyed
+
+		ObjectPool(ObjectPool const &copy) = delete;
+		ObjectPool &operator=(ObjectPool const &copy) = delete;
+
+		template <typename... Args>
+		T		*create(Args&&... args);
+		void	destroy(T *object);
+
+		size_t	live() const { return _live; }
+		size_t	capacity() const { return _slabs.size() * OBJECT_POOL_SLAB; }
+		size_t	slabs() const { return _slabs.size(); }
+};
+
+template <typename T>
+ObjectPool<T>::~ObjectPool()
+{
+	for (Slab *slab : _slabs)
+		delete slab;
+}
+
+template <typename T>
+typename ObjectPool<T>::Slab	*ObjectPool<T>::slabWithRoom()
+{
+	for (size_t n = 0; n < _slabs.size(); n++)
+	{
+		size_t i = (_hint + n) % _slabs.size();
+		if (_slabs[i]->freeMask)
+		{
+			_hint = i;
+			return _slabs[i];
+		}
+	}
+	Slab *slab = new Slab;
+	slab->freeMask = ~static_cast<uint64_t>(0);
+	slab->live = 0;
+	_hint = _slabs.size();
+	_slabs.push_back(slab);
+	return slab;
+}
+
+template <typename T>
+void	ObjectPool<T>::freeSlab(Slab *slab)
+{
+	for (size_t i = 0; i < _slabs.size(); i++)
+	{
+		if (_slabs[i] == slab)
+		{
+			_slabs[i] = _slabs.back();
+			_slabs.pop_back();
+			break;
+		}
+	}
+	_hint = 0;
+	delete slab;
+}
+
+template <typename T>
+template <typename... Args>
+T	*ObjectPool<T>::create(Args&&... args)
+{
+	Slab *slab = slabWithRoom();
+	int index = __builtin_ctzll(slab->freeMask);
+	Cell &cell = slab->cells[index];
+	T *object = new (cell.storage) T(std::forward<Args>(args)...); // Slot is only taken once construction succeeded
+	cell.slab = slab;
+	slab->freeMask &= ~(static_cast<uint64_t>(1) << index);
+	slab->live++;
+	if (slab == _spare)
+		_spare = nullptr;
+	_live++;
+	return object;
+}
+
+template <typename T>
+void	ObjectPool<T>::destroy(T *object)
+{
+	if (!object)
+		return;
+	Cell *cell = reinterpret_cast<Cell*>(reinterpret_cast<unsigned char*>(object) - offsetof(Cell, storage));
+	Slab *slab = cell->slab;
+	object->~T();
+	slab->freeMask |= static_cast<uint64_t>(1) << (cell - slab->cells);
+	slab->live--;
+	_live--;
+	if (slab->live > 0)
+		return;
+	if (!_spare)
+		_spare = slab;
+	else
+		freeSlab(slab); // Past the spare, emptied slabs go back to the heap so RSS drops after a flood
+}
+
+#endif
@@ -4,99 +4,216 @@ Parser::Parser() {}
 
 Parser::~Parser() {}
 
-std::optional<ParsedInput> Parser::parse(std::string const &input)
+static bool	isLetter(char c)
+{
+	return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z');
+}
+
+static bool	isDigit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+static bool	isSpecial(char c) // [ ] \ ` _ ^ { | }
+{
+	return c == '[' || c == ']' || c == '\\' || c == '`' || c == '_' || c == '^' || c == '{' || c == '|' || c == '}';
+}
+
+static bool	isSpace(char c) // same set as \s
+{
+	return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+}
+
+static std::string_view	trimCRLF(std::string_view s)
+{
+	while (!s.empty() && (s.back() == '\r' || s.back() == '\n'))
+		s.remove_suffix(1);
+	return s;
+}
+
+bool	equalsIgnoreCase(std::string_view a, std::string_view b)
+{
+	if (a.size() != b.size())
+		return false;
+	for (size_t i = 0; i < a.size(); ++i)
+	{
+		char x = a[i];
+		char y = b[i];
+		if (x >= 'a' && x <= 'z')
+			x -= 'a' - 'A';
+		if (y >= 'a' && y <= 'z')
+			y -= 'a' - 'A';
+		if (x != y)
+			return false;
+	}
+	return true;
+}
+
+// Switch on length and first letter, then one comparison confirms the only candidate
+CommandId	Parser::lookupCommand(std::string_view command)
+{
+	if (command.empty())
+		return CMD_UNKNOWN;
+
+	char first = command[0] & ~0x20; // ASCII upper case, anything that isn't a letter won't match below
+	CommandId candidate = CMD_UNKNOWN;
+	const char *name = "";
+	switch (command.size())
+	{
+		case 4:
+			switch (first)
+			{
+				case 'P':
+					if ((command[1] & ~0x20) == 'I')
+						candidate = CMD_PING, name = "PING";
+					else if ((command[1] & ~0x20) == 'O')
+						candidate = CMD_PONG, name = "PONG";
+					else if ((command[2] & ~0x20) == 'S')
+						candidate = CMD_PASS, name = "PASS";
+					else
+						candidate = CMD_PART, name = "PART";
+					break;
+				case 'N': candidate = CMD_NICK, name = "NICK"; break;
+				case 'U': candidate = CMD_USER, name = "USER"; break;
+				case 'J': candidate = CMD_JOIN, name = "JOIN"; break;
+				case 'Q': candidate = CMD_QUIT, name = "QUIT"; break;
+				case 'K': candidate = CMD_KICK, name = "KICK"; break;
+				case 'M': candidate = CMD_MODE, name = "MODE"; break;
+				case 'H': candidate = CMD_HELP, name = "HELP"; break;
+			}
+			break;
+		case 5:
+			if (first == 'T')
+				candidate = CMD_TOPIC, name = "TOPIC";
+			else if (first == 'N')
+				candidate = CMD_NAMES, name = "NAMES";
+			else if (first == 'S')
+				candidate = CMD_STATS, name = "STATS";
+			break;
+		case 6:
+			if (first == 'N')
+				candidate = CMD_NOTICE, name = "NOTICE";
+			else if (first == 'I')
+				candidate = CMD_INVITE, name = "INVITE";
+			break;
+		case 7:
+			if (first == 'P')
+				candidate = CMD_PRIVMSG, name = "PRIVMSG";
+			break;
+	}
+	if (candidate != CMD_UNKNOWN && equalsIgnoreCase(command, name))
+		return candidate;
+	return CMD_UNKNOWN;
+}
+
+// Hand written version of
+// ^([A-Za-z\[\]\\`_^{|}][-A-Za-z0-9\[\]\\`_^{|}]*)((![^@\s]+)@([^\s]+))?$|^[a-zA-Z0-9.-]+$
+// i.e. nick[!user@host] or a server name
+bool	Parser::isValidPrefix(std::string_view prefix)
+{
+	if (prefix.empty())
+		return false;
+
+	bool serverName = true;
+	for (char c : prefix)
+	{
+		if (!isLetter(c) && !isDigit(c) && c != '.' && c != '-')
+		{
+			serverName = false;
+			break;
+		}
+	}
+	if (serverName)
+		return true;
+
+	if (!isLetter(prefix[0]) && !isSpecial(prefix[0]))
+		return false;
+	size_t i = 1;
+	while (i < prefix.size() && (isLetter(prefix[i]) || isDigit(prefix[i]) || isSpecial(prefix[i]) || prefix[i] == '-'))
+		i++;
+	if (i == prefix.size())
+		return true; // Just a nickname
+	if (prefix[i] != '!')
+		return false;
+
+	size_t userStart = ++i;
+	while (i < prefix.size() && prefix[i] != '@' && !isSpace(prefix[i]))
+		i++;
+	if (i == userStart || i == prefix.size() || prefix[i] != '@')
+		return false;
+
+	size_t hostStart = ++i;
+	while (i < prefix.size() && !isSpace(prefix[i]))
+		i++;
+	return i == prefix.size() && i > hostStart;
+}
+
+std::optional<ParsedInput> Parser::parse(std::string_view input)
 {
 	if (input.empty() || input.size() > 512)
 		return std::nullopt; // std::optional<T> return for error
 
-	std::string line = input;
-
-	if (std::isspace(line[0]))
+	if (isSpace(input[0]))
 		return std::nullopt;
 	
-	/*if (line.size() >= 2 && line.substr(line.size() - 2) == "\r\n")
-		line = line.substr(0, line.size() - 2);*/
-	// segfault fixed when empty line
-	size_t trim_pos = line.find_last_not_of("\r\n");
-	if (trim_pos != std::string::npos)
-		line.erase(trim_pos + 1);
-	else
-		line.clear();
-
+	std::string_view line = trimCRLF(input);
 
 	ParsedInput result;
 	size_t pos = 0;
 
-	if (line[0] == ':')
+	if (!line.empty() && line[0] == ':')
 	{
 		size_t space = line.find(' ');
-		if (space == std::string::npos)
+		if (space == std::string_view::npos)
 			return std::nullopt;
 
-		std::string prefix_str = line.substr(1, space - 1);
-		std::regex PrefixRegex(R"(^([A-Za-z\[\]\\`_^{|}][-A-Za-z0-9\[\]\\`_^{|}]*)((![^@\s]+)@([^\s]+))?$|^[a-zA-Z0-9.-]+$)");
-		if (!std::regex_match(prefix_str, PrefixRegex))
+		std::string_view prefix = line.substr(1, space - 1);
+		if (!isValidPrefix(prefix))
 			return std::nullopt;
 
-		result.prefix = prefix_str;
+		result.prefix = prefix;
 		pos = space + 1;
-		if (line[pos] == ' ')
+		if (pos < line.size() && line[pos] == ' ')
 			return std::nullopt;
 	}
 		
 	size_t space = line.find(' ', pos);
-	if (space == std::string::npos)
+	if (space == std::string_view::npos)
 	{
 		result.command = line.substr(pos);
-		pos = line.length();
+		pos = line.size();
 	}
 	else
 	{
 		result.command = line.substr(pos, space - pos);
 		pos = space + 1;
 	}
-	std::transform(result.command.begin(), result.command.end(), result.command.begin(), ::toupper);
+	result.commandId = lookupCommand(result.command);
 
-	/*static const std::unordered_set<std::string> validCommand = { "PASS", "NICK", "USER", "JOIN", "PART", "PRIVMSG", "NOTICE", "QUIT", "KICK", "INVITE", "TOPIC", "MODE" };
-	if (validCommand.find(result.command) == validCommand.end())
-		return nullopt;*/
-
-	while (pos < line.length())
+	ParamList &params = result.parameters;
+	while (pos < line.size())
 	{
-		if (pos >= line.length())
-			break;
-		if (pos < line.length() && line[pos] == ' ')
+		if (line[pos] == ' ')
 			return std::nullopt;
 
-		if (result.parameters.size() == 14 && line[pos] != ':')
+		if (params.count == MAX_PARAMS - 1 && line[pos] != ':')
 			return std::nullopt;
 
+		std::string_view param;
 		if (line[pos] == ':')
 		{
-			result.parameters.push_back(line.substr(pos + 1));
-			break ;
+			param = line.substr(pos + 1);
+			pos = line.size();
 		}
-
-		size_t next_space = line.find(' ', pos);
-		if (next_space == std::string::npos)
+		else
 		{
-			result.parameters.push_back(line.substr(pos));
-			break;
-		}
-		result.parameters.push_back(line.substr(pos, next_space - pos));
-		pos = next_space + 1;
-	}
-
-	for (size_t i = 0; i < result.parameters.size(); ++i)
-	{
-		// segfault fixed when empty line
-		if (!result.parameters[i].empty()) {
-			size_t param_pos = result.parameters[i].find_last_not_of("\r\n");
-			if (param_pos != std::string::npos)
-				result.parameters[i].erase(param_pos + 1);
-			else
-				result.parameters[i].clear();
+			size_t next_space = line.find(' ', pos);
+			if (next_space == std::string_view::npos)
+				next_space = line.size();
+			param = line.substr(pos, next_space - pos);
+			pos = next_space + 1;
 		}
+		params.values[params.count++] = trimCRLF(param);
 	}
 
 	return result;
@@ -2,22 +2,55 @@
 # define PARSER_HPP
 
 # include <string>
-# include <vector>
+# include <string_view>
 # include <optional>
-# include <sstream>
-# include <algorithm>
-# include <cctype>
-# include <iostream>
-# include <regex>
-# include <unordered_set>
-
-struct	ParsedInput // IRC message may consist of up to three main parts: the prefix (OPTIONAL), the command, and the command parameters (maximum of 15). The prefix, command and all parameters are separated by one ASCII space character.
+# include <cstddef>
+
+# define MAX_PARAMS 15 // RFC 1459: a message carries at most 15 parameters
+
+enum	CommandId // Interned at parse time, indexes Server's dispatch table
+{
+	CMD_UNKNOWN,
+	CMD_PASS,
+	CMD_NICK,
+	CMD_USER,
+	CMD_JOIN,
+	CMD_PART,
+	CMD_PRIVMSG,
+	CMD_NOTICE,
+	CMD_QUIT,
+	CMD_KICK,
+	CMD_INVITE,
+	CMD_TOPIC,
+	CMD_MODE,
+	CMD_HELP,
+	CMD_NAMES,
+	CMD_STATS,
+	CMD_PING,
+	CMD_PONG,
+	CMD_COUNT
+};
+
+struct	ParamList // Fixed size parameter array, every entry is a view into the line that was parsed
 {
-	std::optional<std::string> prefix; // Preference of prefix is indicated with a single leading ASCII colon character ':', which must be the first character of the essage itself. There must be no gap (whitespace) between the colon and the prefix. The prefix is used by servers to indicate the true origin of the message. If the prefix is missing from the messagem it is assumed to have originated from the connection from which it was received from. HOX! Clients should not use a prefix when sending a message; if they use one, the only valid prefix is the registered nickname associated with the clien.
-	std::string command; // The command must either be a valid IRC command or a three digit number represented in ASCII text.
-	std::vector<std::string> parameters; // IRC messaged are always lines of characters terminated with a CR-LF (Carriage Return - Line Feed) pair, and these messages shall not exceed 512 characters in lenght, counting all characters including the trailing CR-LF. Thus there are 510 characters maximum allowed for the command and its parameters.
+	std::string_view	values[MAX_PARAMS];
+	size_t				count = 0;
+
+	size_t					size() const { return count; }
+	bool					empty() const { return count == 0; }
+	const std::string_view	&operator[](size_t i) const { return values[i]; }
 };
 
+struct	ParsedInput // IRC message may consist of up to three main parts: the prefix (OPTIONAL), the command, and the command parameters (maximum of 15). The prefix, command and all parameters are separated by one ASCII space character. Every field points into the parsed line, which has to outlive it.
+{
+	std::optional<std::string_view> prefix; // Preference of prefix is indicated with a single leading ASCII colon character ':', which must be the first character of the essage itself. There must be no gap (whitespace) between the colon and the prefix. The prefix is used by servers to indicate the true origin of the message. If the prefix is missing from the messagem it is assumed to have originated from the connection from which it was received from. HOX! Clients should not use a prefix when sending a message; if they use one, the only valid prefix is the registered nickname associated with the clien.
+	std::string_view command; // The command must either be a valid IRC command or a three digit number represented in ASCII text. Kept as sent, compare it with equalsIgnoreCase().
+	CommandId commandId = CMD_UNKNOWN; // command mapped case insensitively to its id
+	ParamList parameters; // IRC messaged are always lines of characters terminated with a CR-LF (Carriage Return - Line Feed) pair, and these messages shall not exceed 512 characters in lenght, counting all characters including the trailing CR-LF. Thus there are 510 characters maximum allowed for the command and its parameters.
+};
+
+bool	equalsIgnoreCase(std::string_view a, std::string_view b);
+
 class	Parser
 {
 	private:
@@ -25,11 +58,14 @@ class	Parser
 		Parser(Parser const &copy) = delete;
 		Parser &operator=(Parser const &copy) = delete;
 
+		static bool			isValidPrefix(std::string_view prefix);
+		static CommandId	lookupCommand(std::string_view command);
+
 	public:
 		Parser();
 		~Parser();
 
-		std::optional<ParsedInput> parse(std::string const &input);
+		std::optional<ParsedInput> parse(std::string_view input); // Single pass, allocates nothing
 };
 
 #endif
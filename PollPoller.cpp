@@ -0,0 +1,108 @@
+#include "PollPoller.hpp"
+#include <cerrno>
+#include <stdexcept>
+
+static short	toPollEvents(uint32_t interest)
+{
+	short events = 0;
+	if (interest & Poller::READ)
+		events |= POLLIN;
+	if (interest & Poller::WRITE)
+		events |= POLLOUT;
+	return events;
+}
+
+PollPoller::PollPoller() {}
+
+PollPoller::~PollPoller() {}
+
+size_t	PollPoller::indexOf(int fd) const
+{
+	if (fd < 0 || static_cast<size_t>(fd) >= _index.size() || _index[fd] < 0)
+		return _fds.size();
+	return _index[fd];
+}
+
+void	PollPoller::append(int fd, uint32_t interest, uint64_t token)
+{
+	if (static_cast<size_t>(fd) >= _index.size())
+		_index.resize(fd + 1, -1);
+	_index[fd] = static_cast<int>(_fds.size());
+	_fds.push_back({fd, toPollEvents(interest), 0});
+	_tokens.push_back(token);
+}
+
+void	PollPoller::add(int fd, uint32_t interest, uint64_t token)
+{
+	append(fd, interest, token);
+}
+
+void	PollPoller::addBatch(std::vector<PollRegistration> const &batch)
+{
+	_fds.reserve(_fds.size() + batch.size()); // One reallocation for the whole burst
+	_tokens.reserve(_tokens.size() + batch.size());
+	for (size_t i = 0; i < batch.size(); ++i)
+		append(batch[i].fd, batch[i].interest, batch[i].token);
+}
+
+void	PollPoller::modify(int fd, uint32_t interest, uint64_t token)
+{
+	size_t i = indexOf(fd);
+	if (i == _fds.size())
+		return;
+	_fds[i].events = toPollEvents(interest);
+	_tokens[i] = token;
+}
+
+void	PollPoller::remove(int fd)
+{
+	size_t i = indexOf(fd);
+	if (i == _fds.size())
+		return;
+
+	// Swap the last entry into the hole instead of shifting the whole array
+	size_t last = _fds.size() - 1;
+	if (i != last)
+	{
+		_fds[i] = _fds[last];
+		_tokens[i] = _tokens[last];
+		_index[_fds[i].fd] = static_cast<int>(i);
+	}
+	_fds.pop_back();
+	_tokens.pop_back();
+	_index[fd] = -1;
+}
+
+int	PollPoller::wait(std::vector<PollEvent> &events, int timeout_ms)
+{
+	events.clear();
+	int ret = poll(_fds.data(), _fds.size(), timeout_ms);
+	if (ret < 0)
+	{
+		if (errno == EINTR)
+			return 0;
+		throw std::runtime_error("Error: Poll failed.");
+	}
+
+	for (size_t i = 0; i < _fds.size() && events.size() < static_cast<size_t>(ret); ++i)
+	{
+		short revents = _fds[i].revents;
+		if (!revents)
+			continue;
+
+		uint32_t ready = 0;
+		if (revents & POLLIN)
+			ready |= READ;
+		if (revents & POLLOUT)
+			ready |= WRITE;
+		if (revents & (POLLERR | POLLHUP | POLLNVAL))
+			ready |= ERROR;
+		events.push_back({_tokens[i], ready});
+	}
+	return static_cast<int>(events.size());
+}
+
+const char	*PollPoller::name() const
+{
+	return "poll";
+}
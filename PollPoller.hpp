@@ -0,0 +1,30 @@
+#ifndef POLLPOLLER_HPP
+# define POLLPOLLER_HPP
+
+# include <vector>
+# include <poll.h>
+# include "Poller.hpp"
+
+class	PollPoller : public Poller // Portable level triggered fallback built on poll()
+{
+	private:
+		std::vector<struct pollfd>	_fds; // Array handed to poll()
+		std::vector<uint64_t>		_tokens; // Token of _fds[i] lives in _tokens[i]
+		std::vector<int>			_index; // fd -> position in _fds, -1 when not watched
+
+		size_t	indexOf(int fd) const;
+		void	append(int fd, uint32_t interest, uint64_t token);
+
+	public:
+		PollPoller();
+		~PollPoller();
+
+		void		add(int fd, uint32_t interest, uint64_t token);
+		void		addBatch(std::vector<PollRegistration> const &batch);
+		void		modify(int fd, uint32_t interest, uint64_t token);
+		void		remove(int fd);
+		int			wait(std::vector<PollEvent> &events, int timeout_ms);
+		const char	*name() const;
+};
+
+#endif
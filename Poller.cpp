@@ -0,0 +1,19 @@
+#include "Poller.hpp"
+#include "PollPoller.hpp"
+#include "EpollPoller.hpp"
+#include <stdexcept>
+
+std::unique_ptr<Poller>	Poller::create(std::string const &backend)
+{
+	if (backend == "epoll")
+		return std::unique_ptr<Poller>(new EpollPoller());
+	if (backend == "poll")
+		return std::unique_ptr<Poller>(new PollPoller());
+	throw std::invalid_argument("Unknown event backend: " + backend);
+}
+
+void	Poller::addBatch(std::vector<PollRegistration> const &batch)
+{
+	for (size_t i = 0; i < batch.size(); ++i)
+		add(batch[i].fd, batch[i].interest, batch[i].token);
+}
@@ -0,0 +1,47 @@
+#ifndef POLLER_HPP
+# define POLLER_HPP
+
+# include <cstdint>
+# include <memory>
+# include <string>
+# include <vector>
+
+struct	PollEvent // One ready file descriptor as reported by a backend
+{
+	uint64_t	token; // Opaque value given at registration, handed back untouched so the server never has to look the fd up
+	uint32_t	events; // Combination of Poller::READ, Poller::WRITE and Poller::ERROR
+};
+
+struct	PollRegistration // One fd to start watching, see Poller::addBatch()
+{
+	int			fd;
+	uint32_t	interest;
+	uint64_t	token;
+};
+
+// Event backend interface, Server only talks to this so epoll and poll stay interchangeable. A backend may be edge
+// triggered and report a fd again only after it was drained, so Server reads and accepts until EAGAIN or comes
+// back to the fd on its own
+class	Poller
+{
+	public:
+		enum
+		{
+			READ = 1,
+			WRITE = 2,
+			ERROR = 4
+		};
+
+		virtual ~Poller() {}
+
+		virtual void		add(int fd, uint32_t interest, uint64_t token) = 0;
+		virtual void		addBatch(std::vector<PollRegistration> const &batch); // Registers many fds at once, e.g. after an accept burst
+		virtual void		modify(int fd, uint32_t interest, uint64_t token) = 0;
+		virtual void		remove(int fd) = 0;
+		virtual int			wait(std::vector<PollEvent> &events, int timeout_ms) = 0; // Fills events, returns how many are ready
+		virtual const char	*name() const = 0;
+
+		static std::unique_ptr<Poller>	create(std::string const &backend); // "epoll" or "poll"
+};
+
+#endif
@@ -1,17 +1,42 @@
 #include "Server.hpp"
 
-Server::Server(int port, std::string const &password) : _port(port), _password(password), _parser(nullptr)
+static const uint64_t	LISTENER_TOKEN = 0; // Clients are registered with UserHandle::token(), which is never 0
+
+Server::Server(int port, std::string const &password, ServerConfig const &config) : _port(port), _password(password), _server_fd(-1), _timers(TimerWheel::clockMs()), _floodTimers(TimerWheel::clockMs()), _sendq_limit(config.sendq),
+	_readPauseHigh(std::min<size_t>(READ_PAUSE_HIGH, config.sendq / 2)), _readPauseLow(std::min<size_t>(READ_PAUSE_LOW, config.sendq / 8)),
+	_pingInterval(config.pingInterval * 1000), _pingTimeout(config.pingTimeout * 1000), _registrationTimeout(config.registrationTimeout * 1000),
+	_idleTimeout(config.idleTimeout * 1000), _floodRate(config.floodRate), _floodBurst(config.floodBurst), _floodQueue(config.floodQueue), _acceptPending(false), _acceptRetryAt(0), _reserveFd(-1), _now(TimerWheel::clockMs()), _parser(nullptr)
 {
 	if (port < 0 || port > 65535)
 		throw std::invalid_argument("Invalid port number.");
 
+	_poller = Poller::create(config.backend);
+	_banner = std::make_shared<const std::string>(
+		"\n"
+		"========================================\n"
+		"     Welcome to the IRC Server\n"
+		"========================================\n"
+		"Please authenticate using:\n"
+		"  PASS <password>\n"
+		"  NICK <nickname>\n"
+		"  USER <username> 0 * :<realname>\n"
+		"\n"
+		"Type HELP for available commands\n"
+		"========================================\n\n");
+	if (!config.capture.empty())
+		_capture.open(config.capture);
 	_parser = new Parser(); //once port is valid, to avoid leaks
+	_reserveFd = open("/dev/null", O_RDONLY | O_CLOEXEC);
 }
 
 Server::~Server() 
 {
 	delete _parser;
-	close(_server_fd);
+	_clients.forEach([](User &user) { close(user.getSocket()); });
+	if (_server_fd >= 0)
+		close(_server_fd);
+	if (_reserveFd >= 0)
+		close(_reserveFd);
 }
 
 void	Server::setUpSocket()
@@ -22,12 +47,16 @@ void	Server::setUpSocket()
 	
 	fcntl(_server_fd, F_SETFL, O_NONBLOCK); // Making it non-blocking -> poll() can handle many clients
 
+	int reuse = 1; // Allow a restart while old connections are still in TIME_WAIT (no SO_REUSEPORT, see README)
+	if (setsockopt(_server_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) < 0)
+		throw std::runtime_error("Error: Failed to set socket options.");
+
 	sockaddr_in addr = {};
 	addr.sin_family = AF_INET;
 	addr.sin_port = htons(_port);
 	addr.sin_addr.s_addr = INADDR_ANY; // Modify socket to accept any incoming IP on specified port
 
-	// Next bind socket, begin listening and add server socket to poll list
+	// Next bind socket, begin listening and register server socket with the event backend
 
 	if (bind(_server_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0)
 		throw std::runtime_error("Error: Bind failed.");
@@ -35,149 +64,446 @@ void	Server::setUpSocket()
 	if (listen(_server_fd, SOMAXCONN) <  0)
 		throw std::runtime_error("Error: Listen failed.");
 
-	struct pollfd server_pollfd = {_server_fd, POLLIN, 0};
-	_poll_fds.push_back(server_pollfd);
+	_poller->add(_server_fd, Poller::READ, LISTENER_TOKEN);
 
 	std::cout << "\n========================================\n";
 	std::cout << "    IRC Server Started\n";
 	std::cout << "    Port: " << _port << "\n";
+	std::cout << "    Backend: " << _poller->name() << "\n";
 	std::cout << "========================================\n" << std::endl;
 }
 
 void	Server::acceptNewClient()
 {
-	sockaddr_in client_addr;
-	socklen_t client_len = sizeof(client_addr);
-	int client_fd = accept(_server_fd, (sockaddr*)&client_addr, &client_len); // Accept a client connection
-	if (client_fd < 0)
-		return ;
+	// Drain the listen queue, edge triggered backends report it only once. The cap keeps a connection
+	// storm from starving established clients, what is left is picked up in the next iteration
+	_acceptPending = false;
+	_acceptRetryAt = 0;
+	std::vector<PollRegistration> accepted;
+	size_t shed = 0;
+	while (accepted.size() + shed < ACCEPT_BATCH)
+	{
+		int client_fd = accept4(_server_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC); // Accept a client connection, already non blocking
+		if (client_fd < 0)
+		{
+			int error = errno;
+			if (error == EINTR || error == ECONNABORTED)
+				continue;
+			if ((error == EMFILE || error == ENFILE) && shedConnection())
+			{
+				shed++;
+				continue;
+			}
+			if (error != EAGAIN && error != EWOULDBLOCK)
+			{
+				// No new edge will report what is still queued, come back for it from the loop
+				_acceptRetryAt = _now + ACCEPT_RETRY_MS;
+				LOG(LOG_WARN) << "accept failed: " << strerror(error) << ", retrying in " << ACCEPT_RETRY_MS << " ms";
+			}
+			break;
+		}
 
-	fcntl(client_fd, F_SETFL, O_NONBLOCK); // Set socket to non blocking
-	_poll_fds.push_back({client_fd, POLLIN, 0}); // Add to poll
-	
-	std::string tempNick = "Guest" + std::to_string(client_fd); // Assign temporary nickname
-	_clients[client_fd] = std::make_shared<User>(tempNick, client_fd);
+		int noDelay = 1; // Output is already batched per iteration, Nagle would only hold replies back for a delayed ACK
+		setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
 
-	// Welcome banner
-	std::string banner = 
-		"\n"
-		"========================================\n"
-		"     Welcome to the IRC Server\n"
-		"========================================\n"
-		"Please authenticate using:\n"
-		"  PASS <password>\n"
-		"  NICK <nickname>\n"
-		"  USER <username> 0 * :<realname>\n"
-		"\n"
-		"Type HELP for available commands\n"
-		"========================================\n\n";
-	
-	send(client_fd, banner.c_str(), banner.length(), 0);
+		std::string tempNick = "Guest" + std::to_string(client_fd); // Assign temporary nickname
+		User &client = _clients.emplace(tempNick, client_fd, _buffers); // Slab allocated, no input buffer until data arrives
+		client.setOutboundListener(this); // Not in _nicks until NICK, a Guest nick must not shadow a user who took it
+		Keepalive &keepalive = client.getKeepalive();
+		keepalive.connectedAt = keepalive.lastInput = keepalive.lastCommand = _now;
+		_timers.schedule(keepalive.timer, _now + _registrationTimeout, client.getHandle().token()); // Re-armed by onTimer() once registered
+		client.getFloodControl().bucket.fill(_now, _floodBurst);
+		accepted.push_back({client_fd, Poller::READ, client.getHandle().token()}); // Events map back to the User, stale ones stop resolving
+		_capture.connected(client.getHandle().token());
 
-	std::cout << "[+] Client connected (FD: " << client_fd << ")\n";
+		client.sendLine(_banner); // Welcome banner, one buffer shared by every client
+
+		LOG(LOG_INFO) << "[+] Client connected (FD: " << client_fd << ")";
+	}
+	if (accepted.size() + shed == ACCEPT_BATCH)
+		_acceptPending = true;
+	_poller->addBatch(accepted);
+}
+
+bool	Server::shedConnection()
+{
+	// Out of descriptors: the reserve makes room to accept the next queued connection and close it at once, so its
+	// client is refused instead of waiting in the listen queue until a descriptor frees up
+	if (_reserveFd < 0)
+		return false;
+	close(_reserveFd);
+	int fd = accept4(_server_fd, nullptr, nullptr, SOCK_CLOEXEC);
+	if (fd >= 0)
+		close(fd);
+	_reserveFd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return false;
+	LOG(LOG_WARN) << "Out of file descriptors, connection refused";
+	return true;
 }
 
-void	Server::handleClientInput(int client_fd)
+void	Server::handleClientInput(User& client)
 {
-	char buffer[512];
-	ssize_t bytesRead = recv(client_fd, buffer, sizeof(buffer) - 1, 0);
-	if (bytesRead <= 0)
+	int client_fd = client.getSocket();
+	InputBuffer &inbuf = client.getInputBuffer();
+	size_t budget = READ_BUDGET;
+	size_t commands = COMMAND_BUDGET;
+
+	// Lines left over from an earlier iteration go first, they were sent before anything still in the socket
+	processInput(client, commands);
+
+	// Read until EAGAIN, an edge triggered backend won't report leftover data again. A client that keeps the socket
+	// full gets READ_BUDGET bytes and COMMAND_BUDGET commands per iteration and is resumed in the next one.
+	// A throttled client is not read at all, the flood timer comes back for its input
+	while (!client.isClosing() && !client.isReadPaused() && !client.getFloodControl().timer.armed())
 	{
-		removeClient(client_fd);
-		return;
-	}
+		if (budget == 0 || commands == 0)
+		{
+			_pendingRead.push_back(client.getHandle());
+			return;
+		}
+
+		size_t room = 0;
+		char *dest = inbuf.writeSpace(room); // Never full here, processInput() framed everything but a partial line
+		if (room > budget)
+			room = budget;
 
-	buffer[bytesRead] = '\0';
-	std::string input(buffer);
-	if (DEBUG_MODE) {
-		std::cout << "[DEBUG] handleClientInput called for FD: " << client_fd << std::endl;
-		std::cout << "[DEBUG] bytesRead = " << bytesRead << std::endl;
-		std::cout << "[DEBUG] input = " << input << std::endl;
+		ssize_t bytesRead = recv(client_fd, dest, room, 0);
+		if (bytesRead < 0 && errno == EINTR)
+			continue;
+		if (bytesRead < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+		{
+			inbuf.release(); // Idle clients hold no input buffer, only the ones with a partial line do
+			return;
+		}
+		if (bytesRead <= 0)
+		{
+			removeClient(client, bytesRead == 0 ? "Connection closed" : "Read error");
+			return;
+		}
+
+		LOG(LOG_DEBUG) << "FD " << client_fd << ": read " << bytesRead << " bytes"; // Lines are logged once framed, see processInput()
+
+		inbuf.commit(bytesRead); // Byte count comes from recv(), embedded NULs are kept
+		budget -= bytesRead;
+		processInput(client, commands);
 	}
+}
 
-	// add received data to user's buffer
-	_clients[client_fd]->appendToBuffer(input);
-	
-	// process all complete messages in the buffer
-	while (_clients.count(client_fd) && _clients[client_fd]->hasCompleteMessage())
+void	Server::processInput(User& client, size_t &commands)
+{
+	// process all complete messages in the user's buffer
+	InputBuffer &inbuf = client.getInputBuffer();
+	Keepalive &keepalive = client.getKeepalive();
+	FloodControl &flood = client.getFloodControl();
+	std::string_view completeMessage;
+	InputBuffer::Frame frame;
+	while (commands > 0 && !client.isClosing() && !client.isReadPaused() && (frame = inbuf.nextLine(completeMessage)) != InputBuffer::NONE)
 	{
-		std::string completeMessage = _clients[client_fd]->extractFromBuffer();
-		if (DEBUG_MODE)
-			std::cout << "[DEBUG] Processing complete message: " << completeMessage << std::endl;
-		
+		commands--;
+		if (frame == InputBuffer::TOO_LONG)
+		{
+			client.sendNumericReply(417, ":Input line was too long");
+			continue;
+		}
+
 		auto parsed = _parser->parse(completeMessage);
+		uint64_t cost = parsed ? commandCost(*parsed) : 1;
+		if (_floodRate != 0 && !flood.bucket.take(cost, _now, _floodRate, _floodBurst))
+		{
+			// Out of tokens: this line and everything behind it wait, in the InputBuffer or still in the socket, and the
+			// flood timer resumes them. Only a client that is that far ahead of its tokens is dropped
+			inbuf.putBack();
+			int unread = 0;
+			ioctl(client.getSocket(), FIONREAD, &unread);
+			size_t queued = inbuf.size() + std::max(unread, 0);
+			if (_floodQueue != 0 && queued > _floodQueue)
+			{
+				removeClient(client, "Excess Flood");
+				return;
+			}
+			_floodTimers.schedule(flood.timer, _now + flood.bucket.waitMs(cost, _floodRate), client.getHandle().token());
+			updateInterest(client); // Stops reading until then
+			LOG(LOG_DEBUG) << "FD " << client.getSocket() << ": throttled, " << queued << " bytes queued";
+			return;
+		}
+		LOG(LOG_DEBUG) << "FD " << client.getSocket() << " <- " << Logger::redact(completeMessage);
+		bool password = parsed && parsed->commandId == CMD_PASS;
+		if (!password)
+			_capture.line(client.getHandle().token(), completeMessage);
+		keepalive.lastInput = _now; // Only stamped, the timer is moved when it fires, see onTimer()
+
 		if (!parsed)
 		{
-			if (DEBUG_MODE)
-				std::cout << "[DEBUG] Parsing failed for message: " << completeMessage << std::endl;
-			if (_clients.count(client_fd))
-				_clients[client_fd]->sendMessage("Error: Invalid command.");
+			LOG(LOG_DEBUG) << "FD " << client.getSocket() << ": parsing failed";
+			client.sendMessage("Error: Invalid command.");
 			continue;
 		}
-		if (_clients.count(client_fd))
-			dispatchCommand(_clients[client_fd], *parsed);
-	}
-}
-
-void	Server::dispatchCommand(std::shared_ptr<User> client, ParsedInput const &parsed)
-{
-	const std::string &command = parsed.command;
-	const std::vector<std::string> &params = parsed.parameters;
-	if (command == "PASS")
-	{
-		handlePASS(client, params);
-		return;
-	}
-	else if (command == "HELP")
-		handleHELP(client, params);
-	else if (command == "KICK")
-		handleKICK(client, params);
-	else if (command == "INVITE")
-		handleINVITE(client, params);
-	else if (command == "TOPIC")
-		handleTOPIC(client, params);
-	else if (command == "MODE")
-		handleMODE(client, params);
-	else if (command == "NICK")
-		handleNICK(client, params);
-	else if (command == "USER")
-		handleUSER(client, params);
-	else if (command == "JOIN")
-		handleJOIN(client, params);
-	else if (command == "PART")
-		handlePART(client, params);
-	else if (command == "PRIVMSG")
-		handlePRIVMSG(client, params);
-	else if (command == "NOTICE")
-		handleNOTICE(client, params);
-	else if (command == "QUIT")
-		handleQUIT(client, params);
-	else
+		if (parsed->commandId != CMD_PING && parsed->commandId != CMD_PONG)
+			keepalive.lastCommand = _now;
+		dispatchCommand(client, *parsed);
+		if (password)
+			_capture.password(client.getHandle().token(), client.isAuthenticated()); // With its outcome, the argument is never kept
+		if (client.getSendQueueSize() > _readPauseHigh)
+			updateInterest(client); // Pauses reading, the rest of the input stays where it is
+	}
+}
+
+// Indexed by CommandId. Registration and parameter count are checked here so handlers start with valid input;
+// PASS, NICK and USER check authentication themselves since they are what registers a client.
+// Costs are flood control tokens: JOIN and the listing commands produce the most work, QUIT and PONG are never held back
+const Server::CommandSpec	Server::_commands[CMD_COUNT] = {
+	{"",		nullptr,				false,	false,	0,	1,	""}, // CMD_UNKNOWN
+	{"PASS",	&Server::handlePASS,	false,	false,	1,	1,	" PASS: Not enough parameters"},
+	{"NICK",	&Server::handleNICK,	false,	false,	0,	1,	""},
+	{"USER",	&Server::handleUSER,	false,	false,	0,	1,	""},
+	{"JOIN",	&Server::handleJOIN,	true,	false,	1,	3,	"Usage:\tJOIN #channel [key]"},
+	{"PART",	&Server::handlePART,	true,	false,	1,	1,	"PART :Not enough parameters"},
+	{"PRIVMSG",	&Server::handlePRIVMSG,	true,	false,	2,	1,	"Usage:\tPRIVMSG <target> :<message>"},
+	{"NOTICE",	&Server::handleNOTICE,	true,	true,	2,	1,	""}, // NOTICE never triggers a reply
+	{"QUIT",	&Server::handleQUIT,	false,	false,	0,	0,	""},
+	{"KICK",	&Server::handleKICK,	true,	false,	2,	1,	"Usage:\tKICK #channel <user> :[reason]"},
+	{"INVITE",	&Server::handleINVITE,	true,	false,	2,	1,	"INVITE :Not enough parameters"},
+	{"TOPIC",	&Server::handleTOPIC,	true,	false,	1,	1,	"TOPIC :Not enough parameters"},
+	{"MODE",	&Server::handleMODE,	true,	false,	1,	1,	"MODE :Not enough parameters"},
+	{"HELP",	&Server::handleHELP,	false,	false,	0,	2,	""},
+	{"NAMES",	&Server::handleNAMES,	true,	false,	0,	2,	""},
+	{"STATS",	&Server::handleSTATS,	true,	false,	0,	2,	""},
+	{"PING",	&Server::handlePING,	false,	false,	0,	1,	""},
+	{"PONG",	&Server::handlePONG,	false,	true,	0,	0,	""}, // Any line proves the client alive, PONG just has nothing to answer
+};
+
+uint64_t	Server::commandCost(ParsedInput const &parsed) const
+{
+	uint64_t cost = _commands[parsed.commandId].cost;
+	const ParamList &params = parsed.parameters;
+	if ((parsed.commandId == CMD_PRIVMSG || parsed.commandId == CMD_NOTICE) && !params.empty() && !params[0].empty() && params[0][0] == '#')
+		cost += FLOOD_CHANNEL_COST;
+	return std::min(cost, _floodBurst); // Anything dearer than a full bucket would wait forever
+}
+
+void	Server::dispatchCommand(User& client, ParsedInput const &parsed)
+{
+	const ParamList &params = parsed.parameters;
+	const CommandSpec &spec = _commands[parsed.commandId];
+	if (!spec.handler)
+	{
+		std::string unknown(parsed.command);
+		std::transform(unknown.begin(), unknown.end(), unknown.begin(), ::toupper);
+		client.sendNumericReply(421, unknown + " :Unknown command. Try HELP for available commands");
+		return;
+	}
+	if (spec.needsRegistration && !client.isRegistered())
+	{
+		if (!spec.silent)
+			client.sendNumericReply(451, std::string(spec.name) + " :You have not registered");
+		return;
+	}
+	if (params.size() < spec.minParams)
+	{
+		if (!spec.silent)
+			client.sendNumericReply(461, spec.usage);
+		return;
+	}
+	(this->*spec.handler)(client, params);
+}
+
+void	Server::removeClient(User& client, const std::string& quitMsg)
+{
+	// Only mark the client here: it may be in the middle of a broadcast or a command handler,
+	// so it leaves its channels and its fd is closed in reapClients()
+	if (client.isClosing())
+		return;
+
+	client.markClosing();
+	_poller->remove(client.getSocket());
+	_closing.push_back(std::make_pair(client.getHandle(), quitMsg));
+}
+
+void	Server::reapClients()
+{
+	// Indexed loop: QUIT broadcasts below may push more clients past their SendQ
+	for (size_t i = 0; i < _closing.size(); i++)
+	{
+		UserHandle handle = _closing[i].first;
+		User *found = _clients.get(handle);
+		if (!found)
+			continue;
+
+		User &client = *found;
+		int client_fd = client.getSocket();
+		std::string quitMsg = _closing[i].second; // Copy, _closing may grow while channels are told
+		quitChannels(client, quitMsg);
+		client.flushSendQueue(); // Best effort, e.g. the echo of QUIT
+		LOG(LOG_INFO) << "[-] Client disconnected: " << client.getNickname() << " (FD: " << client_fd << "): " << quitMsg;
+		unindexNick(client);
+		_timers.cancel(client.getKeepalive().timer);
+		_floodTimers.cancel(client.getFloodControl().timer);
+		_capture.disconnected(handle.token());
+		_clients.erase(handle); // Queued events, pending reads and flushes naming it now resolve to nothing
+		close(client_fd);
+	}
+	_closing.clear();
+}
+
+void	Server::flushClient(User &client)
+{
+	if (client.isClosing())
+		return;
+	if (client.getSendQueueSize() > _sendq_limit)
+	{
+		removeClient(client, "SendQ exceeded");
+		return;
+	}
+	if (!client.flushSendQueue())
+	{
+		removeClient(client, "Write error");
+		return;
+	}
+
+	updateInterest(client);
+}
+
+void	Server::updateInterest(User &client)
+{
+	// Backpressure: while more than _readPauseHigh bytes wait for the client its input stays in the socket, so it can't
+	// make the server produce even more for it (JOIN, NAMES, fan-out...). Reading resumes below _readPauseLow
+	size_t queued = client.getSendQueueSize();
+	bool paused = client.isReadPaused();
+	if (!paused && queued > _readPauseHigh)
+	{
+		paused = true;
+		LOG(LOG_DEBUG) << "FD " << client.getSocket() << ": reading paused, " << queued << " bytes queued";
+	}
+	else if (paused && queued <= _readPauseLow)
+	{
+		paused = false;
+		_pendingRead.push_back(client.getHandle()); // Its input may have arrived while paused, no new edge will tell
+	}
+
+	// A throttled client isn't read either, a level triggered backend would otherwise report its input on every wait
+	bool reading = !paused && !client.getFloodControl().timer.armed();
+
+	// Ask for writability only while something is left over, otherwise the backend would wake us for nothing
+	bool pending = client.hasPendingOutput();
+	if (paused == client.isReadPaused() && reading == client.hasReadInterest() && pending == client.hasWriteInterest())
+		return;
+	client.setReadPaused(paused);
+	client.setReadInterest(reading);
+	client.setWriteInterest(pending);
+	_poller->modify(client.getSocket(), (reading ? Poller::READ : 0) | (pending ? Poller::WRITE : 0), client.getHandle().token());
+}
+
+void	Server::onOutboundQueued(User &client)
+{
+	// Nothing is written yet: lines pile up during the iteration and go out together in flushPendingOutput()
+	if (client.isFlushScheduled())
+		return;
+	client.setFlushScheduled(true);
+	_pendingFlush.push_back(client.getHandle());
+}
+
+void	Server::flushPendingOutput()
+{
+	for (size_t i = 0; i < _pendingFlush.size(); i++)
+	{
+		User *client = _clients.get(_pendingFlush[i]);
+		if (!client) // Reaped since it queued its output
+			continue;
+		client->setFlushScheduled(false);
+		flushClient(*client);
+	}
+	_pendingFlush.clear();
+}
+
+void	Server::finishIteration()
+{
+	// Reaping tells channels about departures (more output), flushing may push clients past their SendQ
+	do
+	{
+		reapClients();
+		flushPendingOutput();
+	} while (!_closing.empty());
+	_capture.flush();
+}
+
+int	Server::nextTimeout() const
+{
+	uint64_t now = TimerWheel::clockMs();
+	int keepalive = _timers.timeoutMs(now);
+	int flood = _floodTimers.timeoutMs(now);
+	int timeout = (keepalive < 0 || (flood >= 0 && flood < keepalive)) ? flood : keepalive;
+	if (_acceptRetryAt != 0)
+	{
+		int retry = _acceptRetryAt > now ? static_cast<int>(_acceptRetryAt - now) : 0;
+		if (timeout < 0 || retry < timeout)
+			timeout = retry;
+	}
+	return timeout;
+}
+
+void	Server::runTimers()
+{
+	_timers.advance(_now, _expired);
+	for (size_t i = 0; i < _expired.size(); i++)
 	{
-		client->sendNumericReply(421, parsed.command + " :Unknown command. Try HELP for available commands");
+		User *user = _clients.get(UserHandle::fromToken(_expired[i]));
+		if (user && !user->isClosing())
+			onTimer(*user);
 	}
+	_expired.clear();
+
+	// Tokens are back: run the queued lines, then read on, an edge triggered backend won't report what is still waiting
+	_floodTimers.advance(_now, _expired);
+	for (size_t i = 0; i < _expired.size(); i++)
+	{
+		User *user = _clients.get(UserHandle::fromToken(_expired[i]));
+		if (user && !user->isClosing())
+			handleClientInput(*user);
+		if (user && !user->isClosing())
+			updateInterest(*user); // Reading again, unless it was throttled once more
+	}
+	_expired.clear();
 }
 
-void	Server::removeClient(int client_fd)
+void	Server::onTimer(User& client)
 {
-	std::vector<struct pollfd>::iterator it = _poll_fds.begin();
-	while (it != _poll_fds.end())
+	// Input only stamps the Keepalive, so a busy client costs nothing here until its deadline comes up.
+	// Work out what is really due and either act on it or push the timer to the next deadline
+	Keepalive &keepalive = client.getKeepalive();
+	if (!client.isRegistered())
 	{
-		if (it->fd == client_fd)
+		if (_now >= keepalive.connectedAt + _registrationTimeout)
 		{
-			_poll_fds.erase(it);
-			break;
+			removeClient(client, "Registration timeout");
+			return;
 		}
-		it++;
+		_timers.schedule(keepalive.timer, keepalive.connectedAt + _registrationTimeout, client.getHandle().token());
+		return;
+	}
+
+	if (keepalive.pingSentAt != 0 && keepalive.lastInput >= keepalive.pingSentAt)
+		keepalive.pingSentAt = 0; // Answered, by PONG or anything else
+	if (keepalive.pingSentAt != 0 && _now >= keepalive.pingSentAt + _pingTimeout)
+	{
+		removeClient(client, "Ping timeout: " + std::to_string(_pingTimeout / 1000) + " seconds");
+		return;
+	}
+	if (_idleTimeout != 0 && _now >= keepalive.lastCommand + _idleTimeout)
+	{
+		removeClient(client, "Idle timeout");
+		return;
 	}
 
-	if (_clients.count(client_fd))
+	if (keepalive.pingSentAt == 0 && _now >= keepalive.lastInput + _pingInterval)
 	{
-		std::string nickname = _clients[client_fd]->getNickname();
-		std::cout << "[-] Client disconnected: " << nickname << " (FD: " << client_fd << ")\n";
-		_clients.erase(client_fd);
+		keepalive.pingSentAt = _now;
+		client.sendMessage("PING :irc.server.com");
 	}
-	close(client_fd);
+	uint64_t next = keepalive.pingSentAt != 0 ? keepalive.pingSentAt + _pingTimeout : keepalive.lastInput + _pingInterval;
+	if (_idleTimeout != 0)
+		next = std::min(next, keepalive.lastCommand + _idleTimeout);
+	_timers.schedule(keepalive.timer, next, client.getHandle().token());
 }
 
 void	Server::run() // Main server loop
@@ -186,26 +512,46 @@ void	Server::run() // Main server loop
 
 	while (true)
 	{
-		int ret = poll(_poll_fds.data(), _poll_fds.size(), -1); // Wait activity on any socket
-		if (ret < 0)
-			throw std::runtime_error("Error: Poll failed.");
+		// Wait activity on any socket until the next timer is due, or just poll when work was left over from the previous iteration
+		int timeout = (_pendingRead.empty() && !_acceptPending) ? nextTimeout() : 0;
+		int ready = _poller->wait(_events, timeout);
+		_now = TimerWheel::clockMs();
+		runTimers();
+
+		if (_acceptPending || (_acceptRetryAt != 0 && _now >= _acceptRetryAt))
+			acceptNewClient();
+
+		std::vector<UserHandle> resume;
+		resume.swap(_pendingRead);
+		for (size_t i = 0; i < resume.size(); i++)
+		{
+			User *user = _clients.get(resume[i]);
+			if (user && !user->isClosing())
+				handleClientInput(*user);
+		}
 
-		size_t i = 0;
-		while (i < _poll_fds.size())
+		for (int i = 0; i < ready; i++)
 		{
-			if (_poll_fds[i].revents & POLLIN)
+			const PollEvent &event = _events[i];
+			if (event.token == LISTENER_TOKEN) // If new connection call acceptNewClient
 			{
-				if (_poll_fds[i].fd == _server_fd) // If new connection call acceptNewClient
-					acceptNewClient();
-				else
-					handleClientInput(_poll_fds[i].fd); // If an existing client call handleInput
+				acceptNewClient();
+				continue;
 			}
-			i++;
+
+			User *user = _clients.get(UserHandle::fromToken(event.token));
+			if (!user)
+				continue;
+			if (!user->isClosing() && (event.events & Poller::WRITE))
+				flushClient(*user);
+			if (!user->isClosing() && (event.events & (Poller::READ | Poller::ERROR))) // recv() reports errors and hangups for us
+				handleClientInput(*user);
 		}
+		finishIteration();
 	}
 }
 
-void	Server::handleHELP(std::shared_ptr<User> client, const std::vector<std::string>&)
+void	Server::handleHELP(User& client, const ParamList&)
 {
 	std::string msg =
 		"Available commands:\n"
@@ -217,23 +563,50 @@ void	Server::handleHELP(std::shared_ptr<User> client, const std::vector<std::str
 		"PRIVMSG <target> <msg>		- Send private message\n"
 		"NOTICE <target> <msg>		- Send notice\n"
 		"TOPIC <#chan> <topic>		- View/set topic\n"
+		"NAMES <#chan>			- List channel members\n"
+		"STATS				- Show memory pool usage\n"
 		"KICK <#chan> <nick>		- Kick user\n"
 		"MODE <#chan> +o/-o <nick>	- Set channel modes\n"
 		"QUIT <msg>			- Quit IRC\n";
 
-	client->sendMessage(msg);
+	client.sendMessage(msg);
 }
 
-void Server::handleKICK(std::shared_ptr<User> client, const std::vector<std::string>& params)
+void	Server::handleSTATS(User& client, const ParamList& params)
 {
-	if (params.size() < 2)
+	// Memory pool occupancy, useful to check that a connection flood was given back
+	const ObjectPool<User> &users = _clients.pool();
+	client.sendNumericReply(249, ":users " + std::to_string(users.live()) + "/" + std::to_string(users.capacity())
+		+ " in " + std::to_string(users.slabs()) + " slabs");
+	for (size_t i = 0; i < _buffers.classCount(); i++)
 	{
-		client->sendNumericReply(461, "Usage:\tKICK #channel <user> :[reason]");
+		BufferPool::Stats stats = _buffers.stats(i);
+		client.sendNumericReply(249, ":buffers " + std::to_string(stats.size) + ": " + std::to_string(stats.inUse)
+			+ " in use, " + std::to_string(stats.cached) + " cached");
+	}
+	client.sendNumericReply(249, ":timers " + std::to_string(_timers.size()) + " armed");
+	client.sendNumericReply(219, (params.empty() ? std::string("*") : std::string(params[0])) + " :End of /STATS report");
+}
+
+void	Server::handlePING(User& client, const ParamList& params)
+{
+	if (params.empty())
+	{
+		client.sendNumericReply(409, ":No origin specified");
 		return;
 	}
-	
-	const std::string& channelName = params[0];
-	const std::string& targetNick = params[1];
+	client.sendMessage(":irc.server.com PONG irc.server.com :" + std::string(params[0]));
+}
+
+void	Server::handlePONG(User& client, const ParamList&)
+{
+	client.getKeepalive().pingSentAt = 0;
+}
+
+void Server::handleKICK(User& client, const ParamList& params)
+{
+	const std::string channelName(params[0]);
+	const std::string targetNick(params[1]);
 	std::string reason;
 
 	if (params.size() > 2)
@@ -242,7 +615,7 @@ void Server::handleKICK(std::shared_ptr<User> client, const std::vector<std::str
 	}
 	else
 	{
-		reason = client->getNickname();
+		reason = client.getNickname();
 	}
 
 	Channel* channel = getChannelIfExists(channelName, client);
@@ -251,32 +624,33 @@ void Server::handleKICK(std::shared_ptr<User> client, const std::vector<std::str
 	
 	if (!requireChannelOperator(*channel, client, channelName))
 		return;
+
+	User* target = findUserByNick(targetNick);
+	if (!target || !channel->hasMember(*target))
+	{
+		client.sendNumericReply(441, targetNick + " " + channelName + " :They aren't on that channel");
+		return;
+	}
 	
 	// notify channel about kick
-	std::string kickMessage = ":" + client->getNickname() + " KICK " + channelName + " " + targetNick + " :" + reason;
+	std::string kickMessage = ":" + client.getNickname() + " KICK " + channelName + " " + targetNick + " :" + reason;
 	channel->broadcast(kickMessage);
 	
 	// remove user from channel
-	channel->removeUser(targetNick);
+	channel->removeUser(*target);
 	
 	// remove channel if empty
-	if (channel->getUsers().empty())
+	if (channel->empty())
 	{
 		_channels.erase(channelName);
-		std::cout << "DEBUG!! Removed empty channel: " << channelName << std::endl;
+		LOG(LOG_DEBUG) << "Removed empty channel: " << channelName;
 	}
 }
 
-void Server::handleINVITE(std::shared_ptr<User> client, const std::vector<std::string>& params)
+void Server::handleINVITE(User& client, const ParamList& params)
 {
-	if (params.size() < 2)
-	{
-		client->sendNumericReply(461, "INVITE :Not enough parameters");
-		return;
-	}
-	
-	const std::string& targetNick = params[0];
-	const std::string& channelName = params[1];
+	const std::string targetNick(params[0]);
+	const std::string channelName(params[1]);
 	
 	Channel* channel = getChannelIfExists(channelName, client);
 	if (!channel)
@@ -285,34 +659,28 @@ void Server::handleINVITE(std::shared_ptr<User> client, const std::vector<std::s
 	if (!requireChannelOperator(*channel, client, channelName))
 		return;
 	
-	std::shared_ptr<User> targetUser = findUserByNick(targetNick);
+	User* targetUser = findUserByNick(targetNick);
 	if (!targetUser)
 	{
-		client->sendNumericReply(401, targetNick + " :No such nick/channel");
+		client.sendNumericReply(401, targetNick + " :No such nick/channel");
 		return;
 	}
 	
 	// send invite
-	channel->inviteUser(client->getNickname(), targetNick);
+	channel->inviteUser(client, *targetUser);
 	
 	// notify both users
-	client->sendNumericReply(341, targetNick + " " + channelName);
-	targetUser->sendMessage(":" + client->getNickname() + " INVITE " + targetNick + " " + channelName);
+	client.sendNumericReply(341, targetNick + " " + channelName);
+	targetUser->sendMessage(":" + client.getNickname() + " INVITE " + targetNick + " " + channelName);
 }
 
-void Server::handleTOPIC(std::shared_ptr<User> client, const std::vector<std::string>& params)
+void Server::handleTOPIC(User& client, const ParamList& params)
 {
-	if (params.empty())
-	{
-		client->sendNumericReply(461, "TOPIC :Not enough parameters");
-		return;
-	}
-	
-	const std::string& channelName = params[0];
+	const std::string channelName(params[0]);
 	
 	if (_channels.count(channelName) == 0)
 	{
-		client->sendNumericReply(403, channelName + " :No such channel");
+		client.sendNumericReply(403, channelName + " :No such channel");
 		return;
 	}
 	
@@ -323,55 +691,49 @@ void Server::handleTOPIC(std::shared_ptr<User> client, const std::vector<std::st
 		// get topic
 		std::string topic = channel.getTopic();
 		if (topic.empty())
-			client->sendNumericReply(331, channelName + " :No topic is set");
+			client.sendNumericReply(331, channelName + " :No topic is set");
 		else
-			client->sendNumericReply(332, channelName + " :" + topic);
+			client.sendNumericReply(332, channelName + " :" + topic);
 	}
 	else
 	{
 		// set topic
-		const std::string& newTopic = params[1];
-		channel.setTopic(client->getNickname(), newTopic);
+		const std::string newTopic(params[1]);
+		channel.setTopic(client, newTopic);
 		
 		// broadcast topic change to all users including the setter
-		std::string topicMessage = ":" + client->getNickname() + " TOPIC " + channelName + " :" + newTopic;
+		std::string topicMessage = ":" + client.getNickname() + " TOPIC " + channelName + " :" + newTopic;
 		channel.broadcast(topicMessage); // empty excludeNick means send to all
 	}
 }
 
-void Server::handleMODE(std::shared_ptr<User> client, const std::vector<std::string>& params)
+void Server::handleMODE(User& client, const ParamList& params)
 {
-	if (params.empty())
-	{
-		client->sendNumericReply(461, "MODE :Not enough parameters");
-		return;
-	}
-	
-	const std::string& channelName = params[0];
+	const std::string channelName(params[0]);
 	
 	if (_channels.count(channelName) == 0)
 	{
-		client->sendNumericReply(403, channelName + " :No such channel");
+		client.sendNumericReply(403, channelName + " :No such channel");
 		return;
 	}
 	
 	Channel& channel = _channels.at(channelName);
 	
 	// check if user is operator
-	if (!channel.isOperator(client->getNickname()))
+	if (!channel.isOperator(client))
 	{
-		client->sendNumericReply(482, channelName + " :You're not channel operator");
+		client.sendNumericReply(482, channelName + " :You're not channel operator");
 		return;
 	}
 	
 	if (params.size() == 1)
 	{
 		// get channel modes (simplified)
-		client->sendNumericReply(324, channelName + " +nt");
+		client.sendNumericReply(324, channelName + " +nt");
 		return;
 	}
 	
-	const std::string& modeString = params[1];
+	const std::string modeString(params[1]);
 	size_t paramIndex = 2;
 	bool adding = true;
 	
@@ -388,15 +750,24 @@ void Server::handleMODE(std::shared_ptr<User> client, const std::vector<std::str
 		else
 		{
 			std::string arg = "";
-			if ((c == 'k' || c == 'l' || c == 'o') && paramIndex < params.size())
+			if ((c == 'k' || c == 'l' || c == 'o' || c == 'v') && paramIndex < params.size())
 			{
 				arg = params[paramIndex++];
 			}
 			
-			channel.setMode(c, adding, arg);
+			if (c == 'o' || c == 'v') // membership flags, resolve the nick first
+			{
+				User* target = arg.empty() ? nullptr : findUserByNick(arg);
+				if (target && c == 'o')
+					channel.setOperator(*target, adding);
+				else if (target)
+					channel.setVoice(*target, adding);
+			}
+			else
+				channel.setMode(c, adding, arg);
 			
 			// broadcast change of mode
-			std::string modeMessage = ":" + client->getNickname() + " MODE " + channelName + " " + 
+			std::string modeMessage = ":" + client.getNickname() + " MODE " + channelName + " " + 
 									(adding ? "+" : "-") + c;
 			if (!arg.empty())
 				modeMessage += " " + arg;
@@ -407,109 +778,101 @@ void Server::handleMODE(std::shared_ptr<User> client, const std::vector<std::str
 	}
 }
 
-void	Server::handleNICK(std::shared_ptr<User> client, const std::vector<std::string>& params)
+void	Server::handleNICK(User& client, const ParamList& params)
 {
-	if (!client->isAuthenticated())
+	if (!client.isAuthenticated())
 	{
-		client->sendNumericReply(451, "NICK :You must authenticate first. Use: PASS <password>");
+		client.sendNumericReply(451, "NICK :You must authenticate first. Use: PASS <password>");
 		return;
 	}
 	if (params.empty())
 	{
-		client->sendNumericReply(431, "NICK :No nickname given");
+		client.sendNumericReply(431, "NICK :No nickname given");
 		return;
 	}
 
-	if (client->isRegistered())
+	if (client.isRegistered())
 	{
-		client->sendNumericReply(462, "NICK :You may not re-register");
+		client.sendNumericReply(462, "NICK :You may not re-register");
 		return;
 	}
 
-	std::string newNick = params[0];
+	std::string newNick(params[0]);
 	size_t end = newNick.find_last_not_of("\r\n");
 	if (end != std::string::npos)
 		newNick.erase(end + 1);
 	
-	if (!client->isValidNickname(newNick))
+	if (!client.isValidNickname(newNick))
 	{
-		client->sendNumericReply(432, newNick + ":Invalid nickname");
+		client.sendNumericReply(432, newNick + ":Invalid nickname");
 		return;
 	}
 
-	for (const auto& [fd, user] : _clients)
+	User* owner = findUserByNick(newNick);
+	if (owner && owner != &client) // changing the case of your own nick is fine
 	{
-		if (user->getNickname() == newNick)
-		{
-			client->sendNumericReply(433, newNick + " :Nickname is already in use");
-			return;
-		}
+		client.sendNumericReply(433, newNick + " :Nickname is already in use");
+		return;
 	}
 
-	client->setNickname(newNick);
-	std::cout << "DEBUG!! Set nickname to " << newNick << " for FD: " << client->getSocket() << std::endl;
+	unindexNick(client);
+	client.setNickname(newNick);
+	indexNick(client);
+	LOG(LOG_DEBUG) << "Set nickname to " << newNick << " for FD: " << client.getSocket();
 
-	client->checkRegisteration();
+	client.checkRegisteration();
 }
 
-void	Server::handleUSER(std::shared_ptr<User> client, const std::vector<std::string>& params)
+void	Server::handleUSER(User& client, const ParamList& params)
 {
-	if (!client->isAuthenticated())
+	if (!client.isAuthenticated())
 	{
-		client->sendNumericReply(451, "USER :You have not registered (missing PASS)");
+		client.sendNumericReply(451, "USER :You have not registered (missing PASS)");
 		return;
 	}
 	if (params.size() < 4 || params[3].empty() /*|| params[3][0] != ':'*/)
 	{
-		client->sendNumericReply(461, "Usage:\tUSER <username> 0 * :<realname>");
+		client.sendNumericReply(461, "Usage:\tUSER <username> 0 * :<realname>");
 		return;
 	}
-	if (client->isRegistered())
+	if (client.isRegistered())
 	{
-		client->sendNumericReply(462, "USER :You may not re-register");
+		client.sendNumericReply(462, "USER :You may not re-register");
 		return;
 	}
 
-	std::string username = params[0];
-	std::string realname = params[3];
+	std::string username(params[0]);
+	std::string realname(params[3]);
 
 	if (!username.empty() && (username.back() == '\r' || username.back() == '\n'))
 		username.erase(username.find_last_not_of("\r\n") + 1);
 	if (!realname.empty() && (realname.back() == '\r' || realname.back() == '\n'))
 		realname.erase(realname.find_last_not_of("\r\n") + 1);
 
-	if (!client->isValidUsername(username))
+	if (!client.isValidUsername(username))
 	{
-		client->sendNumericReply(468, ":Invalid username");
+		client.sendNumericReply(468, ":Invalid username");
 		return;
 	}
 
-	if (!client->isValidRealname(realname))
+	if (!client.isValidRealname(realname))
 	{
-		client->sendNumericReply(468, ":Invalid realname");
+		client.sendNumericReply(468, ":Invalid realname");
 		return;
 	}
 
-	client->setUsername(username);
-	client->setRealname(realname);
+	client.setUsername(username);
+	client.setRealname(realname);
 
-	client->setAuthenticated(true);
-	std::cout << "DEBUG!! Set username to " << params[0] << ", realname to " << params[3] << std::endl;
+	client.setAuthenticated(true);
+	LOG(LOG_DEBUG) << "Set username to " << username << ", realname to " << realname << " for FD: " << client.getSocket();
 
-	client->checkRegisteration();
+	client.checkRegisteration();
 }
 
-void	Server::handlePASS(std::shared_ptr<User> client, const std::vector<std::string>& params)
+void	Server::handlePASS(User& client, const ParamList& params)
 {
-	if (params.empty())
-	{
-		client->sendNumericReply(461, " PASS: Not enough parameters");
-		return ;
-	}
-	std::cout << "DEBUG!! Excpected password: " << _password << std::endl;
-	std::cout << "DEBUG!! Received password: " << params[0] << std::endl;
-
-	std::string received = params[0];
+	std::string received(params[0]);
 	// segfault fixed when empty line 
 	size_t trim_pos = received.find_last_not_of("\r\n");
 	if (trim_pos != std::string::npos)
@@ -517,89 +880,72 @@ void	Server::handlePASS(std::shared_ptr<User> client, const std::vector<std::str
 	else
 		received.clear();
 
-	std::cout << "DEBUG!! Expected password: [" << _password << "]" << std::endl;
-	std::cout << "DEBUG!! Received password: [" << received << "]" << std::endl;
-
-	if (client->isAuthenticated())
+	if (client.isAuthenticated())
 	{
-		client->sendNumericReply(462, ":You may not re-register");
+		client.sendNumericReply(462, ":You may not re-register");
 		return;
 	}
 
 	/*if (params.empty())
 	{
-		client->sendNumericReply(461, "PASS :Not enough parameters");
+		client.sendNumericReply(461, "PASS :Not enough parameters");
 		return;
 	}*/
 
 	if (received != _password)
 	{
-		client->sendNumericReply(464, ":Password incorrect");
+		LOG(LOG_INFO) << "Password rejected for FD: " << client.getSocket(); // Never log the password itself
+		client.sendNumericReply(464, ":Password incorrect");
 		return;
 	}
 
-	client->setAuthenticated(true);
+	client.setAuthenticated(true);
 }
 
-void	Server::handlePRIVMSG(std::shared_ptr<User> client, const std::vector<std::string>& params)
+void	Server::handlePRIVMSG(User& client, const ParamList& params)
 {
-	if (!requireRegistration(client, "PRIVMSG"))
-		return;
-
-	if (params.size() < 2)
-	{
-		client->sendNumericReply(461, "Usage:\tPRIVMSG <target> :<message>");
-		return;
-	}
-
-	const std::string& receiver = params[0];
-	const std::string& message = params[1];
+	const std::string receiver(params[0]);
+	const std::string message(params[1]);
 
 	if (receiver[0] == '#')
 	{
 		if (_channels.count(receiver) == 0)
 		{
-			client->sendNumericReply(403, receiver + " :No such channel");
+			client.sendNumericReply(403, receiver + " :No such channel");
 			return;
 		}
 
 		Channel& channel = _channels.at(receiver);
-		if (!channel.hasUser(client->getNickname()))
+		if (!channel.hasMember(client))
 		{
-			client->sendNumericReply(404, receiver + " :Cannot send to channel");
+			client.sendNumericReply(404, receiver + " :Cannot send to channel");
 			return;
 		}
 
-		std::string fullMsg = ":" + client->getNickname() + " PRIVMSG " + receiver + " :" + message;
-		channel.broadcast(fullMsg, client->getNickname());
+		std::string fullMsg = ":" + client.getNickname() + " PRIVMSG " + receiver + " :" + message;
+		channel.broadcast(fullMsg, &client);
 	}
 	else //privmsg to another user
 	{
-		std::cout << "DEBUG !! PRIVMSG from [" << client->getNickname() << "] to [" << receiver << "]" << std::endl;
+		LOG(LOG_DEBUG) << "PRIVMSG from [" << client.getNickname() << "] to [" << receiver << "]";
 
-		std::shared_ptr<User> target = findUserByNick(receiver);
+		User* target = findUserByNick(receiver);
 		if (!target)
 		{
-			client->sendNumericReply(401, receiver + " :No such nick");
+			client.sendNumericReply(401, receiver + " :No such nick");
 			return;
 		}
 
-		std::string fullMsg = ":" + client->getNickname() + " PRIVMSG " + receiver + " :" + message;
-		std::cout << "DEBUG!! Sending message to " << target->getNickname() << ": " << fullMsg << std::endl;
+		std::string fullMsg = ":" + client.getNickname() + " PRIVMSG " + receiver + " :" + message;
+		LOG(LOG_DEBUG) << "Sending message to " << target->getNickname() << ": " << fullMsg;
 		target->sendMessage(fullMsg);
 	}
 }
 
-void	Server::handleNOTICE(std::shared_ptr<User> client, const std::vector<std::string>& params)
+void	Server::handleNOTICE(User& client, const ParamList& params)
 {
-	if (!client->isRegistered())
-		return;
-	
-	if (params.size() < 2)
-		return;
-
-	const std::string& receiver = params[0];
-	const std::string& message = params[1];
+	const std::string receiver(params[0]);
+	const std::string message(params[1]);
 
 	if (receiver[0] == '#')
 	{
@@ -607,44 +953,32 @@ void	Server::handleNOTICE(std::shared_ptr<User> client, const std::vector<std::s
 			return;
 
 		Channel& channel = _channels.at(receiver);
-		if (!channel.hasUser(client->getNickname()))
+		if (!channel.hasMember(client))
 			return;
 
-		std::string fullMsg = ":" + client->getNickname() + " NOTICE " + receiver + " :" + message;
-		channel.broadcast(fullMsg, client->getNickname());
+		std::string fullMsg = ":" + client.getNickname() + " NOTICE " + receiver + " :" + message;
+		channel.broadcast(fullMsg, &client);
 	}
 	else
 	{
-		for (const auto& [fd, user] : _clients)
+		User* target = findUserByNick(receiver);
+		if (target)
 		{
-			if (user->getNickname() == receiver)
-			{
-				std::string fullMsg = ":" + client->getNickname() + " NOTICE " + receiver + " :" + message;
-				user->sendMessage(fullMsg);
-				break;
-			}
+			std::string fullMsg = ":" + client.getNickname() + " NOTICE " + receiver + " :" + message;
+			target->sendMessage(fullMsg);
 		}
 	}
 }
 
 
-void	Server::handleJOIN(std::shared_ptr<User> client, const std::vector<std::string>& params)
+void	Server::handleJOIN(User& client, const ParamList& params)
 {
-	if (!requireRegistration(client, "JOIN"))
-		return;
-
-	if (params.empty())
-	{
-		client->sendNumericReply(461, "Usage:\tJOIN #channel [key]");
-		return;
-	}
-
-	const std::string& channelName = params[0];
+	const std::string channelName(params[0]);
 	
 	// validate channel name
 	if (channelName.empty() || channelName[0] != '#')
 	{
-		client->sendNumericReply(403, channelName + " :No such channel");
+		client.sendNumericReply(403, channelName + " :No such channel");
 		return;
 	}
 
@@ -654,7 +988,7 @@ void	Server::handleJOIN(std::shared_ptr<User> client, const std::vector<std::str
 	{
 		_channels.emplace(std::piecewise_construct, 
 						  std::forward_as_tuple(channelName), 
-						  std::forward_as_tuple(channelName));
+						  std::forward_as_tuple(channelName, _clients));
 	}
 
 	Channel& channel = _channels.at(channelName);
@@ -669,13 +1003,13 @@ void	Server::handleJOIN(std::shared_ptr<User> client, const std::vector<std::str
 		// If new channel, make the first user an operator
 		if (isNewChannel)
 		{
-			channel.addOperator(client->getNickname());
-			client->sendMessage(":irc.server.com NOTICE " + client->getNickname() + 
+			channel.setOperator(client, true);
+			client.sendMessage(":irc.server.com NOTICE " + client.getNickname() + 
 				" :You have been made channel operator of " + channelName);
 		}
 		
 		// send JOIN message to all users in channel including the joiner
-		std::string joinMsg = ":" + client->getNickname() + " JOIN " + channelName;
+		std::string joinMsg = ":" + client.getNickname() + " JOIN " + channelName;
 		// send JOIN message to all users in channel including the joiner
 		channel.broadcast(joinMsg);
 		
@@ -683,53 +1017,51 @@ void	Server::handleJOIN(std::shared_ptr<User> client, const std::vector<std::str
 		std::string topic = channel.getTopic();
 		if (!topic.empty())
 		{
-			client->sendNumericReply(332, channelName + " :" + topic);
+			client.sendNumericReply(332, channelName + " :" + topic);
 		}
 		else
 		{
-			client->sendNumericReply(331, channelName + " :No topic is set");
+			client.sendNumericReply(331, channelName + " :No topic is set");
 		}
 		
 		// send channel names list (353 and 366)
-		std::string namesList = "";
-		auto users = channel.getUsers();
-		for (const auto& [nick, user] : users)
-		{
-			if (!namesList.empty())
-				namesList += " ";
-			if (channel.isOperator(nick))
-				namesList += "@";
-			namesList += nick;
-		}
-		client->sendNumericReply(353, "= " + channelName + " :" + namesList);
-		client->sendNumericReply(366, channelName + " :End of /NAMES list");
+		sendNames(client, channel);
 	}
 	else
 	{
-		client->sendNumericReply(473, channelName + " :Cannot join channel");
+		client.sendNumericReply(473, channelName + " :Cannot join channel");
 	}
 }
 
-void	Server::handlePART(std::shared_ptr<User> client, const std::vector<std::string>& params)
+void	Server::handleNAMES(User& client, const ParamList& params)
 {
-	if (!requireRegistration(client, "PART"))
+	if (params.empty())
+	{
+		client.sendNumericReply(366, "* :End of /NAMES list");
 		return;
+	}
 
-	if (params.empty())
+	const std::string channelName(params[0]);
+	std::map<std::string, Channel>::iterator it = _channels.find(channelName);
+	if (it == _channels.end())
 	{
-		client->sendNumericReply(461, "PART :Not enough parameters");
+		client.sendNumericReply(366, channelName + " :End of /NAMES list");
 		return;
 	}
+	sendNames(client, it->second);
+}
 
-	const std::string& channelName = params[0];
+void	Server::handlePART(User& client, const ParamList& params)
+{
+	const std::string channelName(params[0]);
 	
 	Channel* channel = getChannelIfExists(channelName, client);
 	if (!channel)
 		return;
 	
-	if (!channel->hasUser(client->getNickname()))
+	if (!channel->hasMember(client))
 	{
-		client->sendNumericReply(442, channelName + " :You're not on that channel");
+		client.sendNumericReply(442, channelName + " :You're not on that channel");
 		return;
 	}
 
@@ -739,21 +1071,21 @@ void	Server::handlePART(std::shared_ptr<User> client, const std::vector<std::str
 		partMsg = params[1];
 
 	// send PART message to all users in channel including the one leaving
-	std::string fullMsg = ":" + client->getNickname() + " PART " + channelName + " :" + partMsg;
+	std::string fullMsg = ":" + client.getNickname() + " PART " + channelName + " :" + partMsg;
 	channel->broadcast(fullMsg);
 	
 	// remove user from channel
-	channel->removeUser(client->getNickname());
+	channel->removeUser(client);
 	
 	// remove channel if empty
-	if (channel->getUsers().empty())
+	if (channel->empty())
 	{
 		_channels.erase(channelName);
-		std::cout << "DEBUG!! Removed empty channel: " << channelName << std::endl;
+		LOG(LOG_DEBUG) << "Removed empty channel: " << channelName;
 	}
 }
 
-void	Server::handleQUIT(std::shared_ptr<User> client, const std::vector<std::string>& params)
+void	Server::handleQUIT(User& client, const ParamList& params)
 {
 	//not fully tested
 	std::string quitMsg = "Client Quit";
@@ -764,76 +1096,82 @@ void	Server::handleQUIT(std::shared_ptr<User> client, const std::vector<std::str
 			quitMsg = quitMsg.substr(1);
 	}
 
-	std::string fullMsg = ":" + client->getNickname() + " QUIT :" + quitMsg;
-	std::string clientNick = client->getNickname(); // Store nickname before removal
+	std::string fullMsg = ":" + client.getNickname() + " QUIT :" + quitMsg;
 	
 	// send quit message to client first
-	std::cout << "DEBUG!! QUIT: " << fullMsg << std::endl;
-	client->sendMessage(fullMsg);
+	LOG(LOG_DEBUG) << "QUIT: " << fullMsg;
+	client.sendMessage(fullMsg);
+
+	// remove the client at end of connection, channels are informed when it is reaped
+	removeClient(client, quitMsg);
+}
+
+void	Server::quitChannels(User& client, const std::string& quitMsg)
+{
+	std::string fullMsg = ":" + client.getNickname() + " QUIT :" + quitMsg;
 
-	// inform all users in channels and clean up empty channels
-	std::vector<std::string> emptyChannels;
-	for (std::map<std::string, Channel>::iterator it = _channels.begin(); it != _channels.end(); ++it)
+	// inform users in the client's own channels and clean up the ones left empty,
+	// copy the list since removeUser() edits it
+	std::vector<Channel*> joined = client.getChannels();
+	for (Channel* channel : joined)
 	{
-		Channel& channel = it->second;
-		if (channel.hasUser(clientNick))
+		if (channel->hasMember(client)) // the list also holds channels the client was only invited to
+			channel->broadcast(fullMsg, &client);
+		channel->removeUser(client);
+
+		if (channel->empty())
 		{
-			channel.broadcast(fullMsg, clientNick);
-			channel.removeUser(clientNick);
-			
-			// Mark channel for removal if empty
-			if (channel.getUsers().empty())
-				emptyChannels.push_back(it->first);
+			std::string channelName = channel->getName();
+			_channels.erase(channelName);
+			LOG(LOG_DEBUG) << "Removed empty channel: " << channelName;
 		}
 	}
-	
-	// remove empty channels
-	for (const std::string& channelName : emptyChannels)
-	{
-		_channels.erase(channelName);
-		std::cout << "DEBUG!! Removed empty channel: " << channelName << std::endl;
-	}
-	
-	// remove the client at end of connection
-	removeClient(client->getSocket());
 }
 
 // helpers
-std::shared_ptr<User> Server::findUserByNick(const std::string& nickname)
+User* Server::findUserByNick(const std::string& nickname)
 {
-	for (const auto& [fd, user] : _clients)
-	{
-		if (user->getNickname() == nickname)
-			return user;
-	}
-	return nullptr;
+	std::unordered_map<std::string, User*>::const_iterator it = _nicks.find(ircCaseFold(nickname));
+	if (it == _nicks.end())
+		return nullptr;
+	return it->second;
 }
 
-bool Server::requireRegistration(std::shared_ptr<User> client, const std::string& command)
+void Server::indexNick(User& client)
 {
-	if (!client->isRegistered())
-	{
-		client->sendNumericReply(451, command + " :You have not registered");
-		return false;
-	}
-	return true;
+	_nicks[ircCaseFold(client.getNickname())] = &client;
+}
+
+void Server::unindexNick(User& client)
+{
+	std::unordered_map<std::string, User*>::iterator it = _nicks.find(ircCaseFold(client.getNickname()));
+	if (it != _nicks.end() && it->second == &client)
+		_nicks.erase(it);
+}
+
+void Server::sendNames(User& client, const Channel& channel)
+{
+	const std::string& channelName = channel.getName();
+	for (const std::string& names : channel.getNamesReply())
+		client.sendNumericReply(353, "= " + channelName + " :" + names);
+	client.sendNumericReply(366, channelName + " :End of /NAMES list");
 }
 
-Channel* Server::getChannelIfExists(const std::string& channelName, std::shared_ptr<User> client)
+Channel* Server::getChannelIfExists(const std::string& channelName, User& client)
 {
 	if (_channels.count(channelName) == 0)
 	{
-		client->sendNumericReply(403, channelName + " :No such channel");
+		client.sendNumericReply(403, channelName + " :No such channel");
 		return nullptr;
 	}
 	return &_channels.at(channelName);
 }
 
-bool Server::requireChannelOperator(Channel& channel, std::shared_ptr<User> client, const std::string& channelName)
+bool Server::requireChannelOperator(Channel& channel, User& client, const std::string& channelName)
 {
-	if (!channel.isOperator(client->getNickname()))
+	if (!channel.isOperator(client))
 	{
-		client->sendNumericReply(482, channelName + " :You're not channel operator");
+		client.sendNumericReply(482, channelName + " :You're not channel operator");
 		return false;
 	}
 	return true;
@@ -1,74 +1,174 @@
 #ifndef SERVER_HPP
 # define SERVER_HPP
 
-// set to false to disable debug output
-#define DEBUG_MODE 1
+// bytes read from one client per loop iteration before the others get their turn
+#define READ_BUDGET (64 * 1024)
+
+// commands run for one client per loop iteration, the rest of its input waits for the next one
+#define COMMAND_BUDGET 32
+
+// outbound bytes queued for a client above which its input is no longer read, and the level that resumes reading
+#define READ_PAUSE_HIGH (64 * 1024)
+#define READ_PAUSE_LOW (16 * 1024)
+
+// connections accepted per loop iteration during a connection storm
+#define ACCEPT_BATCH 256
+
+// wait before the listen queue is tried again after accept() failed for lack of memory or descriptors
+#define ACCEPT_RETRY_MS 100
+
+// extra flood control tokens for PRIVMSG/NOTICE to a channel, which is delivered once per member
+#define FLOOD_CHANNEL_COST 1
 
 # include <string>
 # include <iostream>
 # include <cstring>
+# include <cerrno>
 # include <vector>
 # include <map>
+# include <unordered_map>
 # include <optional>
-# include <poll.h>
+# include <memory>
+# include <algorithm>
 # include <netinet/in.h>
+# include <netinet/tcp.h>
 # include <unistd.h>
 # include <fcntl.h>
 # include <sys/socket.h>
+# include <sys/ioctl.h>
 # include <arpa/inet.h>
 # include "Parser.hpp"
 # include "User.hpp"
 # include "Channel.hpp"
+# include "Poller.hpp"
+# include "ClientTable.hpp"
+# include "BufferPool.hpp"
+# include "Logger.hpp"
+# include "Capture.hpp"
+# include "TimerWheel.hpp"
 
 class User;
 class Channel;
 class Parser;
 struct ParsedInput;
 
-class Server
+struct	ServerConfig // Runtime tunables, filled from the optional --key=value arguments
 {
+	std::string	backend = "epoll"; // Event backend: "epoll" (edge triggered) or "poll" (portable fallback)
+	size_t		sendq = 1024 * 1024; // Bytes a client may have waiting in its outbound queue before it is dropped
+	LogLevel	logLevel = LOG_INFO; // Messages below this level are skipped
+	std::string	capture; // File recording every inbound line for bench/replay.cpp, empty to disable
+	size_t		pingInterval = 120; // Seconds without input before a registered client is sent a PING
+	size_t		pingTimeout = 60; // Seconds it has to answer, by any line, before it is dropped
+	size_t		registrationTimeout = 30; // Seconds to complete PASS, NICK and USER
+	size_t		idleTimeout = 0; // Seconds without a command other than PING/PONG before a client is dropped, 0 to never
+	size_t		floodRate = 10; // Flood control tokens a client gets per second, 0 disables flood control
+	size_t		floodBurst = 20; // Tokens a client can save up, i.e. commands of cost 1 it may send at once
+	size_t		floodQueue = 64 * 1024; // Bytes of input a throttled client may have waiting, buffered or unread, 0 for no limit
+};
+
+class Server : private OutboundListener // Single reactor: the thread calling run() owns every client and channel, see README
+{
+	friend class ServerBench; // bench/microbench.cpp drives dispatchCommand() without sockets
+
 	private:
 		int _port; // Port number that server listens.
 		std::string _password; // Password required to connect
 		int	_server_fd; // File descriptor for the main server socket
-		std::map<int, std::shared_ptr<User>> _clients; // Stores connected clients using their socket file descriptor as the key
+		BufferPool _buffers; // Input buffers of every client, declared first so it outlives them
+		TimerWheel _timers; // One armed TimerNode per client (Keepalive::timer), tokens are UserHandle::token()
+		TimerWheel _floodTimers; // FloodControl::timer of the clients waiting for tokens, same tokens
+		ClientTable _clients; // Owns the connected clients, handed around by UserHandle or plain reference
+		std::unordered_map<std::string, User*> _nicks; // Case folded nickname -> client, set by NICK. Temporary Guest nicks are not indexed
 		std::map<std::string, Channel> _channels; // Maps channel names to Channel objects
-		std::vector<struct pollfd> _poll_fds; // Monitoring multiple socket FDs
+		std::unique_ptr<Poller> _poller; // Event backend monitoring the listening socket and every client
+		std::vector<PollEvent> _events; // Ready events of the current loop iteration
+		std::vector<std::pair<UserHandle, std::string>> _closing; // Clients marked for removal with their quit message, closed once the current iteration is done
+		size_t _sendq_limit; // Outbound queue limit in bytes, see ServerConfig::sendq
+		size_t _readPauseHigh; // READ_PAUSE_HIGH, lowered to half of a small _sendq_limit so clients are paused before they are dropped
+		size_t _readPauseLow;
+		uint64_t _pingInterval; // Milliseconds, see ServerConfig
+		uint64_t _pingTimeout;
+		uint64_t _registrationTimeout;
+		uint64_t _idleTimeout; // 0: disabled
+		uint64_t _floodRate; // See ServerConfig, 0: disabled
+		uint64_t _floodBurst;
+		size_t _floodQueue; // 0: no limit
+		std::vector<UserHandle> _pendingFlush; // Clients that queued output during the current iteration
+		std::vector<UserHandle> _pendingRead; // Clients that used up READ_BUDGET with data possibly left in the socket
+		bool _acceptPending; // The last accept round hit ACCEPT_BATCH, the listen queue may not be empty
+		uint64_t _acceptRetryAt; // accept() failed with the queue not drained, try again at this time. 0 when not waiting
+		int _reserveFd; // Spare descriptor given up to refuse a connection once the fd limit is reached, see shedConnection()
+		uint64_t _now; // TimerWheel::clockMs(), sampled once per loop iteration
+		std::vector<uint64_t> _expired; // Timer tokens returned by the current advance()
+		SharedLine _banner; // Welcome banner queued to every new client
+		Capture _capture; // Inbound traffic recording, see ServerConfig::capture
 
 		Parser* _parser;
 
+		struct	CommandSpec // One row of the dispatch table, see _commands in Server.cpp
+		{
+			const char	*name;
+			void		(Server::*handler)(User& client, const ParamList& params);
+			bool		needsRegistration; // 451 until the client is registered
+			bool		silent; // Failed checks are not answered (NOTICE)
+			size_t		minParams; // Fewer parameters get a 461 with usage
+			uint64_t	cost; // Flood control tokens, see commandCost()
+			const char	*usage;
+		};
+		static const CommandSpec _commands[CMD_COUNT];
+
 		Server(Server const &copy) = delete;
 		Server &operator=(Server const &copy) = delete;
 
 		void	setUpSocket();
 		void	acceptNewClient();
-		void	handleClientInput(int client_fd);
-		void	removeClient(int client_fd);
-		void	dispatchCommand(std::shared_ptr<User> client, ParsedInput const &parsed);
+		bool	shedConnection();
+		void	handleClientInput(User& client);
+		void	processInput(User& client, size_t &commands);
+		void	removeClient(User& client, const std::string& quitMsg);
+		void	reapClients();
+		void	quitChannels(User& client, const std::string& quitMsg);
+		void	flushClient(User &client);
+		void	updateInterest(User &client);
+		void	onOutboundQueued(User &client);
+		void	flushPendingOutput();
+		void	finishIteration();
+		void	dispatchCommand(User& client, ParsedInput const &parsed);
+		uint64_t	commandCost(ParsedInput const &parsed) const;
+		int		nextTimeout() const;
+		void	runTimers();
+		void	onTimer(User& client);
 
 		//commands //kick, invite, topic, mode (i, t, k, o, l)
-		void	handleKICK(std::shared_ptr<User> client, const std::vector<std::string>& params);
-		void	handleINVITE(std::shared_ptr<User> client, const std::vector<std::string>& params);
-		void	handleTOPIC(std::shared_ptr<User> client, const std::vector<std::string>& params);
-		void	handleMODE(std::shared_ptr<User> client, const std::vector<std::string>& params);
-		void	handleNICK(std::shared_ptr<User> client, const std::vector<std::string>& params);
-		void	handleUSER(std::shared_ptr<User> client, const std::vector<std::string>& params);
-		void	handlePASS(std::shared_ptr<User> client, const std::vector<std::string>& params);
-		void	handlePRIVMSG(std::shared_ptr<User> client, const std::vector<std::string>& params);
-		void	handleNOTICE(std::shared_ptr<User> client, const std::vector<std::string>& params);
-		void	handleJOIN(std::shared_ptr<User> client, const std::vector<std::string>& params);
-		void	handlePART(std::shared_ptr<User> client, const std::vector<std::string>& params);
-		void	handleQUIT(std::shared_ptr<User> client, const std::vector<std::string>& params);
-		void	handleHELP(std::shared_ptr<User> client, const std::vector<std::string>&);
+		void	handleKICK(User& client, const ParamList& params);
+		void	handleINVITE(User& client, const ParamList& params);
+		void	handleTOPIC(User& client, const ParamList& params);
+		void	handleMODE(User& client, const ParamList& params);
+		void	handleNICK(User& client, const ParamList& params);
+		void	handleUSER(User& client, const ParamList& params);
+		void	handlePASS(User& client, const ParamList& params);
+		void	handlePRIVMSG(User& client, const ParamList& params);
+		void	handleNOTICE(User& client, const ParamList& params);
+		void	handleJOIN(User& client, const ParamList& params);
+		void	handlePART(User& client, const ParamList& params);
+		void	handleQUIT(User& client, const ParamList& params);
+		void	handleNAMES(User& client, const ParamList& params);
+		void	handleHELP(User& client, const ParamList& params);
+		void	handleSTATS(User& client, const ParamList& params);
+		void	handlePING(User& client, const ParamList& params);
+		void	handlePONG(User& client, const ParamList& params);
 
 		// helpers
-		std::shared_ptr<User>	findUserByNick(const std::string& nickname);
-		bool					requireRegistration(std::shared_ptr<User> client, const std::string& command);
-		Channel*				getChannelIfExists(const std::string& channelName, std::shared_ptr<User> client);
-		bool					requireChannelOperator(Channel& channel, std::shared_ptr<User> client, const std::string& channelName);
+		User*					findUserByNick(const std::string& nickname); // case insensitive, see ircCaseFold()
+		void					indexNick(User& client);
+		void					unindexNick(User& client);
+		void					sendNames(User& client, const Channel& channel);
+		Channel*				getChannelIfExists(const std::string& channelName, User& client);
+		bool					requireChannelOperator(Channel& channel, User& client, const std::string& channelName);
 
 	public:
-		Server(int port, std::string const &password);
+		Server(int port, std::string const &password, ServerConfig const &config = ServerConfig());
 		~Server();
 
 		void	run();
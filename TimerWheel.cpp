@@ -0,0 +1,128 @@
+#include "TimerWheel.hpp"
+#include <algorithm>
+#include <ctime>
+
+#define TIMER_WHEEL_MASK (TIMER_WHEEL_SLOTS - 1)
+
+TimerWheel::TimerWheel(uint64_t nowMs) : _tick(nowMs / TIMER_TICK_MS), _count(0)
+{
+	for (int level = 0; level < TIMER_WHEEL_LEVELS; level++)
+	{
+		for (TimerNode &sentinel : _slots[level])
+			sentinel.prev = sentinel.next = &sentinel;
+	}
+}
+
+void	TimerWheel::link(TimerNode &node)
+{
+	// Level L holds the deadlines less than 64^(L+1) ticks away. A deadline past the last level is parked in its
+	// farthest slot and placed again when that slot is cascaded
+	uint64_t expires = node.expires;
+	uint64_t delta = expires > _tick ? expires - _tick : 0;
+	int level = 0;
+	while (level < TIMER_WHEEL_LEVELS - 1 && delta >= (1ull << (TIMER_WHEEL_BITS * (level + 1))))
+		level++;
+	if (delta >= (1ull << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS)))
+		expires = _tick + (1ull << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS)) - 1;
+
+	TimerNode &sentinel = _slots[level][(expires >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK];
+	node.prev = sentinel.prev;
+	node.next = &sentinel;
+	sentinel.prev->next = &node;
+	sentinel.prev = &node;
+	_count++;
+}
+
+void	TimerWheel::unlink(TimerNode &node)
+{
+	node.prev->next = node.next;
+	node.next->prev = node.prev;
+	node.prev = node.next = nullptr;
+	_count--;
+}
+
+void	TimerWheel::cascade(int level)
+{
+	// Every deadline in this slot is now less than 64^level ticks away and lands on a lower level
+	TimerNode &sentinel = _slots[level][(_tick >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK];
+	while (sentinel.next != &sentinel)
+	{
+		TimerNode &node = *sentinel.next;
+		unlink(node);
+		link(node);
+	}
+}
+
+void	TimerWheel::schedule(TimerNode &node, uint64_t expiresMs, uint64_t token)
+{
+	if (node.armed())
+		unlink(node);
+	node.expires = std::max((expiresMs + TIMER_TICK_MS - 1) / TIMER_TICK_MS, _tick + 1); // The current tick was already run
+	node.token = token;
+	link(node);
+}
+
+void	TimerWheel::cancel(TimerNode &node)
+{
+	if (node.armed())
+		unlink(node);
+}
+
+void	TimerWheel::advance(uint64_t nowMs, std::vector<uint64_t> &expired)
+{
+	uint64_t target = nowMs / TIMER_TICK_MS;
+	while (_tick < target)
+	{
+		if (_count == 0)
+		{
+			_tick = target; // Nothing armed, no slot to visit on the way
+			break;
+		}
+		_tick++;
+
+		// Highest wrapping level first, its timers may land in a lower slot that is due right now
+		int wrapped = 0;
+		while (wrapped < TIMER_WHEEL_LEVELS - 1 && ((_tick >> (TIMER_WHEEL_BITS * (wrapped + 1))) << (TIMER_WHEEL_BITS * (wrapped + 1))) == _tick)
+			wrapped++;
+		for (int level = wrapped; level > 0; level--)
+			cascade(level);
+
+		TimerNode &sentinel = _slots[0][_tick & TIMER_WHEEL_MASK];
+		while (sentinel.next != &sentinel)
+		{
+			TimerNode &node = *sentinel.next;
+			unlink(node);
+			expired.push_back(node.token);
+		}
+	}
+}
+
+int	TimerWheel::timeoutMs(uint64_t nowMs) const
+{
+	if (_count == 0)
+		return -1;
+
+	// Next occupied slot of level 0, or the next wrap of level 0 at the latest since it may cascade timers down
+	uint64_t tick = _tick + 1;
+	while ((tick & TIMER_WHEEL_MASK) != 0)
+	{
+		TimerNode const &sentinel = _slots[0][tick & TIMER_WHEEL_MASK];
+		if (sentinel.next != &sentinel)
+			break;
+		tick++;
+	}
+	uint64_t due = tick * TIMER_TICK_MS;
+	return due > nowMs ? static_cast<int>(due - nowMs) : 0;
+}
+
+size_t	TimerWheel::size() const
+{
+	return _count;
+}
+
+uint64_t	TimerWheel::clockMs()
+{
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now); // vDSO, no syscall
+	return static_cast<uint64_t>(now.tv_sec) * 1000 + now.tv_nsec / 1000000;
+}
@@ -0,0 +1,52 @@
+#ifndef TIMERWHEEL_HPP
+# define TIMERWHEEL_HPP
+
+# include <cstddef>
+# include <cstdint>
+# include <vector>
+
+# define TIMER_TICK_MS 100 // Resolution of every timeout, deadlines are rounded up to the next tick
+# define TIMER_WHEEL_BITS 6
+# define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_BITS)
+# define TIMER_WHEEL_LEVELS 4 // 64^4 ticks of 100 ms, about 19 days. Later deadlines wait in the last level
+
+struct	TimerNode // Embedded in the object it times, so arming and cancelling allocate nothing
+{
+	TimerNode	*prev = nullptr; // nullptr while not armed
+	TimerNode	*next = nullptr;
+	uint64_t	expires = 0; // Tick
+	uint64_t	token = 0; // Handed back on expiry, e.g. a UserHandle::token()
+
+	bool	armed() const { return prev != nullptr; }
+};
+
+// Hierarchical timing wheel: level 0 has one slot per tick, each higher level one slot per full turn of the level
+// below. Arming and cancelling are O(1); a slot of a higher level is spread over the level below when the lower
+// wheel wraps around to it. Timers that are re-armed before they expire never get touched by advance()
+class	TimerWheel
+{
+	private:
+		TimerNode	_slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS]; // Sentinels of circular lists
+		uint64_t	_tick; // Last tick processed by advance()
+		size_t		_count;
+
+		void	link(TimerNode &node);
+		void	unlink(TimerNode &node);
+		void	cascade(int level);
+
+	public:
+		explicit TimerWheel(uint64_t nowMs);
+
+		TimerWheel(TimerWheel const &copy) = delete;
+		TimerWheel &operator=(TimerWheel const &copy) = delete;
+
+		void	schedule(TimerNode &node, uint64_t expiresMs, uint64_t token); // Moves node if already armed
+		void	cancel(TimerNode &node); // No-op when not armed
+		void	advance(uint64_t nowMs, std::vector<uint64_t> &expired); // Appends the tokens of expired timers, disarmed
+		int		timeoutMs(uint64_t nowMs) const; // Wait before advance() can have work, -1 when nothing is armed
+		size_t	size() const;
+
+		static uint64_t	clockMs(); // CLOCK_MONOTONIC in milliseconds
+};
+
+#endif
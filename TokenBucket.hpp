@@ -0,0 +1,42 @@
+#ifndef TOKENBUCKET_HPP
+# define TOKENBUCKET_HPP
+
+# include <algorithm>
+# include <cstdint>
+
+// Rate limiter refilled lazily on use: rate tokens per second, holding at most burst. Levels are kept in
+// thousandths of a token so millisecond clocks refill it without rounding
+class	TokenBucket
+{
+	private:
+		uint64_t	_level; // Thousandths of a token
+		uint64_t	_refilledAt; // Milliseconds
+
+	public:
+		TokenBucket() : _level(0), _refilledAt(0) {}
+
+		void	fill(uint64_t nowMs, uint64_t burst)
+		{
+			_level = burst * 1000;
+			_refilledAt = nowMs;
+		}
+
+		bool	take(uint64_t cost, uint64_t nowMs, uint64_t rate, uint64_t burst) // cost must not exceed burst
+		{
+			if (nowMs > _refilledAt)
+				_level = std::min(burst * 1000, _level + (nowMs - _refilledAt) * rate);
+			_refilledAt = std::max(_refilledAt, nowMs);
+			if (_level < cost * 1000)
+				return false;
+			_level -= cost * 1000;
+			return true;
+		}
+
+		uint64_t	waitMs(uint64_t cost, uint64_t rate) const // After a failed take(): time until cost tokens are there
+		{
+			uint64_t missing = cost * 1000 > _level ? cost * 1000 - _level : 0;
+			return (missing + rate - 1) / rate;
+		}
+};
+
+#endif
@@ -11,26 +11,27 @@
 /* ************************************************************************** */
 
 #include "User.hpp"
+#include <cerrno>
+#include <sys/uio.h>
 
-User::User(std::string nick, int sock) : _nickname(std::move(nick)), _socket(sock), _authenticated(false), _registered(false), _hasSetNick(false)
+User::User(std::string nick, int sock, BufferPool& buffers) : _nickname(std::move(nick)), _socket(sock), _handle(), _authenticated(false), _registered(false), _hasSetNick(false), _closing(false), _input(buffers), _sendQueueSize(0), _sendOffset(0), _readInterest(true), _writeInterest(false), _readPaused(false), _flushScheduled(false), _outboundListener(nullptr)
 {
     // should we initialize these? 
     _username = "";
     _realname = "";
-    _buffer.clear(); // empty buffer?
 }
 
-std::string User::getNickname() const
+const std::string& User::getNickname() const
 { 
     return _nickname;
 }
 
-std::string User::getUsername() const
+const std::string& User::getUsername() const
 {
     return _username;
 }
 
-std::string User::getRealname() const
+const std::string& User::getRealname() const
 {
     return _realname;
 }
@@ -40,6 +41,16 @@ int User::getSocket() const
     return _socket;
 }
 
+UserHandle User::getHandle() const
+{
+    return _handle;
+}
+
+void User::setHandle(UserHandle handle)
+{
+    _handle = handle;
+}
+
 bool User::isAuthenticated() const
 {
     return _authenticated;
@@ -50,6 +61,11 @@ bool User::isRegistered() const
     return _registered;
 }
 
+bool User::isClosing() const
+{
+    return _closing;
+}
+
 void	User::checkRegisteration()
 {
 	if (isAuthenticated() && !isRegistered() && _hasSetNick && !_username.empty()) // replacing _nickname.empty() with _hasSetNick
@@ -88,37 +104,173 @@ void User::setRegistered(bool reg)
     _registered = reg;
 }
 
-void User::appendToBuffer(const std::string& data)
+void User::markClosing()
 {
-    _buffer += data;
+    _closing = true;
 }
 
-std::string User::extractFromBuffer() 
+InputBuffer& User::getInputBuffer()
 {
-	size_t pos = _buffer.find("\r\n");
-	if (pos == std::string::npos)
-		pos = _buffer.find("\n");
-	
-	if (pos != std::string::npos)
+	return _input;
+}
+
+Keepalive& User::getKeepalive()
+{
+	return _keepalive;
+}
+
+FloodControl& User::getFloodControl()
+{
+	return _flood;
+}
+
+void User::addChannel(Channel* channel)
+{
+	_channels.push_back(channel);
+}
+
+void User::removeChannel(Channel* channel)
+{
+	// a user is in a handful of channels, a swap-remove on a small vector beats any set
+	for (size_t i = 0; i < _channels.size(); i++)
 	{
-		std::string message = _buffer.substr(0, pos);
-		_buffer.erase(0, pos + ((_buffer[pos] == '\r') ? 2 : 1));
-		return message;
+		if (_channels[i] == channel)
+		{
+			_channels[i] = _channels.back();
+			_channels.pop_back();
+			return;
+		}
 	}
-	return "";
 }
 
-bool User::hasCompleteMessage() const
+const std::vector<Channel*>& User::getChannels() const
 {
-	return (_buffer.find("\r\n") != std::string::npos || _buffer.find("\n") != std::string::npos);
+	return _channels;
+}
+
+SharedLine makeSharedLine(const std::string& message)
+{
+	std::shared_ptr<std::string> line = std::make_shared<std::string>();
+	line->reserve(message.size() + 2);
+	line->append(message).append("\r\n");
+	return line;
 }
 
 void User::sendMessage(const std::string& message) 
 {
-    // send message to socket_
+    // queue message, the listener (the server) writes everything queued during a loop iteration at once
     //std::cout << "To [" << _nickname << "]: " << message << "\n";
-	std::string msgWithCRLF = message + "\r\n";
-	send(_socket, msgWithCRLF.c_str(), msgWithCRLF.size(), 0);
+	if (_closing)
+		return;
+	sendLine(makeSharedLine(message));
+}
+
+void User::sendLine(const SharedLine& line)
+{
+	if (_closing)
+		return;
+	_sendQueue.push_back(line);
+	_sendQueueSize += line->size();
+	if (_outboundListener)
+		_outboundListener->onOutboundQueued(*this);
+}
+
+bool User::flushSendQueue()
+{
+	// hand the kernel every queued line in one writev() instead of one send() per line
+	while (!_sendQueue.empty())
+	{
+		struct iovec iov[FLUSH_IOV_MAX];
+		int count = 0;
+		for (std::deque<SharedLine>::const_iterator it = _sendQueue.begin(); it != _sendQueue.end() && count < FLUSH_IOV_MAX; ++it, ++count)
+		{
+			size_t skip = (count == 0) ? _sendOffset : 0;
+			iov[count].iov_base = const_cast<char*>((*it)->data() + skip);
+			iov[count].iov_len = (*it)->size() - skip;
+		}
+
+		struct msghdr msg = {};
+		msg.msg_iov = iov;
+		msg.msg_iovlen = count;
+		ssize_t sent = sendmsg(_socket, &msg, MSG_NOSIGNAL); // writev() that doesn't raise SIGPIPE
+		if (sent < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			return (errno == EAGAIN || errno == EWOULDBLOCK); // socket full, the rest waits for writability
+		}
+
+		_sendQueueSize -= sent;
+		size_t left = sent;
+		while (left > 0)
+		{
+			size_t frontLeft = _sendQueue.front()->size() - _sendOffset;
+			if (left < frontLeft)
+			{
+				_sendOffset += left;
+				return true; // short write, socket is full
+			}
+			left -= frontLeft;
+			_sendQueue.pop_front();
+			_sendOffset = 0;
+		}
+	}
+	return true;
+}
+
+bool User::hasPendingOutput() const
+{
+	return !_sendQueue.empty();
+}
+
+size_t User::getSendQueueSize() const
+{
+	return _sendQueueSize;
+}
+
+bool User::isFlushScheduled() const
+{
+	return _flushScheduled;
+}
+
+void User::setFlushScheduled(bool scheduled)
+{
+	_flushScheduled = scheduled;
+}
+
+bool User::hasReadInterest() const
+{
+	return _readInterest;
+}
+
+void User::setReadInterest(bool interest)
+{
+	_readInterest = interest;
+}
+
+bool User::hasWriteInterest() const
+{
+	return _writeInterest;
+}
+
+void User::setWriteInterest(bool interest)
+{
+	_writeInterest = interest;
+}
+
+bool User::isReadPaused() const
+{
+	return _readPaused;
+}
+
+void User::setReadPaused(bool paused)
+{
+	_readPaused = paused;
+}
+
+void User::setOutboundListener(OutboundListener *listener)
+{
+	_outboundListener = listener;
 }
 
 void User::sendNumericReply(int code, const std::string& message)
@@ -146,6 +298,25 @@ std::string	User::getCurrentDate() const
 	return dateStr;
 }
 
+std::string	ircCaseFold(const std::string& name)
+{
+	std::string folded(name);
+	for (char& c : folded)
+	{
+		if (c >= 'A' && c <= 'Z')
+			c += 'a' - 'A';
+		else if (c == '[')
+			c = '{';
+		else if (c == ']')
+			c = '}';
+		else if (c == '\\')
+			c = '|';
+		else if (c == '~')
+			c = '^';
+	}
+	return folded;
+}
+
 bool	User::isValidNickname(const std::string& nickname)
 {
 	// wuppa missed a parenthesis
@@ -17,6 +17,48 @@
 #include <sys/socket.h>
 #include <ctime>
 #include <sstream>
+#include <memory>
+#include <deque>
+#include <vector>
+#include <cstdint>
+#include "InputBuffer.hpp"
+#include "UserHandle.hpp"
+#include "TimerWheel.hpp"
+#include "TokenBucket.hpp"
+
+class User;
+class Channel;
+
+#define FLUSH_IOV_MAX 64 // queued lines handed to a single sendmsg() call
+
+typedef std::shared_ptr<const std::string> SharedLine; // immutable serialized line (with CRLF), queued by reference to every recipient
+
+SharedLine makeSharedLine(const std::string& message);
+
+// RFC 1459 casemapping: A-Z are lower-cased and []\~ are the upper-case forms of {}|^
+std::string ircCaseFold(const std::string& name);
+
+class OutboundListener // Told whenever a User queues outbound data, the event loop decides when it hits the socket
+{
+    public:
+        virtual ~OutboundListener() {}
+        virtual void onOutboundQueued(User &user) = 0;
+};
+
+struct Keepalive // liveness bookkeeping, evaluated lazily by Server::onTimer() when its timer fires
+{
+    TimerNode   timer;           // the connection's single deadline: registration, PONG or idle, whichever is next
+    uint64_t    connectedAt = 0; // milliseconds, TimerWheel::clockMs()
+    uint64_t    lastInput = 0;   // any inbound line, resets the keepalive PING
+    uint64_t    lastCommand = 0; // any line but PING/PONG, resets the idle timeout
+    uint64_t    pingSentAt = 0;  // 0 while no PING is outstanding
+};
+
+struct FloodControl // per connection rate limit, see Server::processInput()
+{
+    TokenBucket bucket;
+    TimerNode   timer; // armed while lines wait in the InputBuffer for tokens
+};
 
 class User {
 
@@ -25,33 +67,67 @@ class User {
         std::string _username;
         std::string _realname;
         int         _socket;
+        UserHandle  _handle;      // assigned when the ClientTable takes ownership
         bool        _authenticated;
         bool        _registered;
         bool        _hasSetNick;  // flag to check if user has set a nickname
-        std::string _buffer; //helpful to have the incoming data until a complete message is formed
+        bool        _closing;     // set once the server decided to drop the connection
+        InputBuffer _input; // incoming data until a complete message is formed
+        std::deque<SharedLine> _sendQueue; // serialized lines waiting for the socket, possibly shared with other users
+        size_t      _sendQueueSize;   // bytes left in _sendQueue
+        size_t      _sendOffset;      // bytes of _sendQueue.front() already written
+        bool        _readInterest;    // whether the event backend currently watches this socket for readability
+        bool        _writeInterest;   // whether the event backend currently watches this socket for writability
+        bool        _readPaused;      // input is left unread until the client has taken most of its output
+        bool        _flushScheduled;  // already in the server's list of sockets to flush this loop iteration
+        OutboundListener *_outboundListener;
+        std::vector<Channel*> _channels; // channels this user has joined, kept in sync by Channel::addUser/removeUser
+        Keepalive   _keepalive;
+        FloodControl _flood;
     public:
     
-        User(std::string nick, int sock);
-        std::string getNickname() const;
-        std::string getUsername() const;
-        std::string getRealname() const;
+        User(std::string nick, int sock, BufferPool& buffers); // input storage is taken from buffers while data is pending
+        const std::string& getNickname() const;
+        const std::string& getUsername() const;
+        const std::string& getRealname() const;
 
         int getSocket() const;
+        UserHandle getHandle() const; // stable name for this connection, goes stale once it is gone
+        void setHandle(UserHandle handle);
         bool isAuthenticated() const;
         bool isRegistered() const;
+        bool isClosing() const;
 
         void setNickname(const std::string& nick);
         void setUsername(const std::string& user);
         void setRealname(const std::string& real);
         void setAuthenticated(bool auth);
         void setRegistered(bool reg);
+        void markClosing();
 		void	checkRegisteration();
 
-        void appendToBuffer(const std::string& data);
-        std::string extractFromBuffer();
-        bool hasCompleteMessage() const;
+        InputBuffer& getInputBuffer();
+        Keepalive& getKeepalive();
+        FloodControl& getFloodControl();
+
+        void addChannel(Channel* channel);
+        void removeChannel(Channel* channel);
+        const std::vector<Channel*>& getChannels() const;
 
         void sendMessage(const std::string& message);
+        void sendLine(const SharedLine& line); // queue an already serialized line without copying it
+        bool flushSendQueue(); // writes as much as the socket takes in as few syscalls as possible, false on a socket error
+        bool hasPendingOutput() const;
+        size_t getSendQueueSize() const;
+        bool isFlushScheduled() const;
+        void setFlushScheduled(bool scheduled);
+        bool hasReadInterest() const;
+        void setReadInterest(bool interest);
+        bool hasWriteInterest() const;
+        void setWriteInterest(bool interest);
+        bool isReadPaused() const;
+        void setReadPaused(bool paused);
+        void setOutboundListener(OutboundListener *listener);
         void sendNumericReply(int code, const std::string& message);
 
 		std::string	getCurrentDate() const;
@@ -0,0 +1,19 @@
+#ifndef USERHANDLE_HPP
+# define USERHANDLE_HPP
+
+# include <cstdint>
+
+struct	UserHandle // Names a connected client: slot in the ClientTable plus the slot's generation when the client got it
+{
+	uint32_t	slot;
+	uint32_t	generation; // Bumped every time the slot is freed, so handles kept after a disconnect stop resolving
+
+	bool	operator==(UserHandle const &other) const { return slot == other.slot && generation == other.generation; }
+	bool	operator!=(UserHandle const &other) const { return !(*this == other); }
+
+	// Packed into a Poller token. Generations start at 1, so a live handle never packs to 0
+	uint64_t			token() const { return (static_cast<uint64_t>(generation) << 32) | slot; }
+	static UserHandle	fromToken(uint64_t token) { return UserHandle{static_cast<uint32_t>(token), static_cast<uint32_t>(token >> 32)}; }
+};
+
+#endif
@@ -0,0 +1,116 @@
+#include "BenchUtil.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <stdexcept>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+uint64_t	nowNs()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+sockaddr_in	resolveAddress(std::string const &host, int port)
+{
+	sockaddr_in addr = {};
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	if (inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1)
+		throw std::runtime_error("invalid host " + host);
+	return addr;
+}
+
+int	connectTo(sockaddr_in const &addr)
+{
+	int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0 || connect(fd, reinterpret_cast<sockaddr const*>(&addr), sizeof(addr)) < 0)
+	{
+		std::string reason = strerror(errno);
+		if (fd >= 0)
+			close(fd);
+		throw std::runtime_error("connect failed: " + reason);
+	}
+	int one = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)); // Latency, not batching, is measured
+	fcntl(fd, F_SETFL, O_NONBLOCK);
+	return fd;
+}
+
+pid_t	spawnServer(std::string const &path, sockaddr_in const &addr, std::string const &password)
+{
+	// Bind like the server does first: if someone else listens there, the readiness check below would reach them and
+	// the bench would measure the wrong server
+	sockaddr_in any = addr;
+	any.sin_addr.s_addr = INADDR_ANY;
+	int reserve = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	int one = 1;
+	setsockopt(reserve, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	bool taken = bind(reserve, reinterpret_cast<sockaddr const*>(&any), sizeof(any)) < 0;
+	close(reserve);
+	if (taken)
+		throw std::runtime_error("port " + std::to_string(ntohs(addr.sin_port)) + " is already in use");
+
+	pid_t pid = fork();
+	if (pid < 0)
+		throw std::runtime_error("fork failed");
+	if (pid == 0)
+	{
+		int devnull = open("/dev/null", O_WRONLY);
+		dup2(devnull, STDOUT_FILENO);
+		std::string port = std::to_string(ntohs(addr.sin_port));
+		// Flood control off: the benches measure how fast the server goes, not how fast it lets one client go
+		execl(path.c_str(), path.c_str(), port.c_str(), password.c_str(), "--flood-rate=0", static_cast<char*>(nullptr));
+		_exit(127);
+	}
+
+	// Wait until it listens, or stops trying to
+	for (int attempt = 0; attempt < 100; attempt++)
+	{
+		int status = 0;
+		if (waitpid(pid, &status, WNOHANG) == pid)
+			throw std::runtime_error("spawned server exited with status " + std::to_string(WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status)));
+		int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		bool up = connect(fd, reinterpret_cast<sockaddr const*>(&addr), sizeof(addr)) == 0;
+		close(fd);
+		if (up)
+			return pid;
+		usleep(20000);
+	}
+	stopServer(pid);
+	throw std::runtime_error("spawned server did not start listening");
+}
+
+void	stopServer(pid_t pid)
+{
+	kill(pid, SIGTERM);
+	waitpid(pid, nullptr, 0);
+}
+
+std::string	latencySummary(std::vector<uint32_t> &samples)
+{
+	std::sort(samples.begin(), samples.end());
+	auto percentile = [&](double p) -> uint32_t {
+		if (samples.empty())
+			return 0;
+		return samples[std::min(samples.size() - 1, static_cast<size_t>(p * samples.size()))];
+	};
+	return "p50 " + std::to_string(percentile(0.50)) + ", p99 " + std::to_string(percentile(0.99))
+		+ ", p999 " + std::to_string(percentile(0.999)) + ", max " + std::to_string(samples.empty() ? 0 : samples.back());
+}
+
+bool	isWelcomeReply(std::string const &line)
+{
+	// ":<server> 1 <nick> :..." - ircserv does not zero pad its numerics
+	size_t space = line.find(' ');
+	if (line.empty() || line[0] != ':' || space == std::string::npos)
+		return false;
+	return line.compare(space, 3, " 1 ") == 0 || line.compare(space, 5, " 001 ") == 0;
+}
@@ -0,0 +1,20 @@
+#ifndef BENCHUTIL_HPP
+# define BENCHUTIL_HPP
+
+# include <cstdint>
+# include <string>
+# include <vector>
+# include <netinet/in.h>
+# include <sys/types.h>
+
+// Shared by the loopback tools (loadgen, replay)
+
+uint64_t	nowNs(); // Monotonic, the same clock the server's capture uses
+sockaddr_in	resolveAddress(std::string const &host, int port); // Throws on an invalid IPv4 address
+int			connectTo(sockaddr_in const &addr); // Connected, non blocking, TCP_NODELAY socket; throws on failure
+pid_t		spawnServer(std::string const &path, sockaddr_in const &addr, std::string const &password); // Returns once it listens
+void		stopServer(pid_t pid);
+std::string	latencySummary(std::vector<uint32_t> &samples); // "p50 .., p99 .., p999 .., max .." in microseconds, sorts samples
+bool		isWelcomeReply(std::string const &line); // RPL_WELCOME, the server's banner says "Welcome" before PASS is checked
+
+#endif
@@ -0,0 +1,348 @@
+// Load generator for ircserv: registers N clients, spreads them over M channels and drives PRIVMSG traffic at a
+// fixed rate. Every message carries its send time, receivers turn that into a delivery latency. Generator and
+// server must share a clock, i.e. run on the same machine (loopback).
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "BenchUtil.hpp"
+
+struct	BenchConfig
+{
+	std::string	host = "127.0.0.1";
+	int			port = 6667;
+	std::string	password = "bench";
+	size_t		clients = 200;
+	size_t		channels = 0; // Fan-out of a message is clients / channels - 1 receivers. 0: 10, or fewer for fewer clients
+	size_t		rate = 5000; // PRIVMSG per second, summed over all senders
+	double		duration = 5; // Seconds of traffic, after warm-up
+	std::string	spawn; // Path of an ircserv to start on port, empty to use a running server
+};
+
+struct	Connection
+{
+	int			fd = -1;
+	size_t		channel = 0;
+	std::string	in; // Received bytes not yet split into lines
+	std::string	out; // Bytes the socket didn't take yet
+	bool		registered = false;
+	bool		joined = false;
+	bool		writeInterest = false; // EPOLLOUT is registered
+};
+
+static bool	parseOption(std::string const &arg, BenchConfig &config)
+{
+	size_t eq = arg.find('=');
+	if (arg.compare(0, 2, "--") != 0 || eq == std::string::npos)
+		return false;
+	std::string key = arg.substr(2, eq - 2);
+	std::string value = arg.substr(eq + 1);
+	try
+	{
+		if (key == "host")
+			config.host = value;
+		else if (key == "port")
+			config.port = std::stoi(value);
+		else if (key == "password")
+			config.password = value;
+		else if (key == "clients")
+			config.clients = std::stoul(value);
+		else if (key == "channels")
+			config.channels = std::stoul(value);
+		else if (key == "rate")
+			config.rate = std::stoul(value);
+		else if (key == "duration")
+			config.duration = std::stod(value);
+		else if (key == "spawn")
+			config.spawn = value;
+		else
+			return false;
+	}
+	catch (const std::exception &e)
+	{
+		return false;
+	}
+	return true;
+}
+
+static bool	validConfig(BenchConfig const &config) // Checked once all options are in, they constrain each other
+{
+	return config.clients > 0 && config.channels > 0 && config.channels <= config.clients && config.rate > 0;
+}
+
+class	LoadGenerator
+{
+	private:
+		BenchConfig				_config;
+		int						_epoll;
+		std::vector<Connection>	_conns;
+		size_t					_registered;
+		size_t					_joined;
+		uint64_t				_sent;
+		uint64_t				_delivered;
+		std::vector<uint32_t>	_latencies; // Microseconds, one per delivered PRIVMSG
+
+		void	connectAll();
+		void	queue(Connection &conn, std::string const &line);
+		void	flush(Connection &conn);
+		void	poll(int timeout_ms);
+		void	readFrom(Connection &conn);
+		void	handleLine(Connection &conn, std::string const &line);
+		void	waitFor(size_t const &counter, size_t target, const char *phase);
+
+	public:
+		explicit LoadGenerator(BenchConfig const &config);
+		~LoadGenerator();
+
+		void	run();
+		void	report(double elapsed);
+};
+
+LoadGenerator::LoadGenerator(BenchConfig const &config) : _config(config), _epoll(epoll_create1(EPOLL_CLOEXEC)), _registered(0), _joined(0), _sent(0), _delivered(0)
+{
+	if (_epoll < 0)
+		throw std::runtime_error("epoll_create1 failed");
+	_conns.resize(_config.clients);
+}
+
+LoadGenerator::~LoadGenerator()
+{
+	for (Connection &conn : _conns)
+	{
+		if (conn.fd >= 0)
+			close(conn.fd);
+	}
+	close(_epoll);
+}
+
+void	LoadGenerator::connectAll()
+{
+	sockaddr_in addr = resolveAddress(_config.host, _config.port);
+	for (size_t i = 0; i < _conns.size(); i++)
+	{
+		Connection &conn = _conns[i];
+		conn.fd = connectTo(addr);
+
+		epoll_event event = {};
+		event.events = EPOLLIN;
+		event.data.u64 = i;
+		epoll_ctl(_epoll, EPOLL_CTL_ADD, conn.fd, &event);
+
+		conn.channel = i % _config.channels;
+		std::string nick = "b" + std::to_string(i);
+		queue(conn, "PASS " + _config.password);
+		queue(conn, "NICK " + nick);
+		queue(conn, "USER " + nick + " 0 * :bench");
+	}
+}
+
+void	LoadGenerator::queue(Connection &conn, std::string const &line)
+{
+	bool idle = conn.out.empty();
+	conn.out += line;
+	conn.out += "\r\n";
+	if (idle)
+		flush(conn);
+}
+
+void	LoadGenerator::flush(Connection &conn)
+{
+	while (!conn.out.empty())
+	{
+		ssize_t written = send(conn.fd, conn.out.data(), conn.out.size(), MSG_NOSIGNAL);
+		if (written < 0 && errno == EINTR)
+			continue;
+		if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			break;
+		if (written < 0)
+			throw std::runtime_error(std::string("send failed: ") + strerror(errno));
+		conn.out.erase(0, written);
+	}
+
+	bool pending = !conn.out.empty();
+	if (pending == conn.writeInterest)
+		return;
+	conn.writeInterest = pending;
+	epoll_event event = {};
+	event.events = EPOLLIN | (pending ? static_cast<uint32_t>(EPOLLOUT) : 0);
+	event.data.u64 = &conn - _conns.data();
+	epoll_ctl(_epoll, EPOLL_CTL_MOD, conn.fd, &event);
+}
+
+void	LoadGenerator::poll(int timeout_ms)
+{
+	epoll_event events[256];
+	int ready = epoll_wait(_epoll, events, 256, timeout_ms);
+	for (int i = 0; i < ready; i++)
+	{
+		Connection &conn = _conns[events[i].data.u64];
+		if (events[i].events & EPOLLOUT)
+			flush(conn);
+		if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+			readFrom(conn);
+	}
+}
+
+void	LoadGenerator::readFrom(Connection &conn)
+{
+	char buffer[65536];
+	ssize_t received = recv(conn.fd, buffer, sizeof(buffer), 0);
+	if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+		return;
+	if (received <= 0)
+		throw std::runtime_error("server closed a connection");
+
+	conn.in.append(buffer, received);
+	size_t start = 0;
+	size_t newline;
+	while ((newline = conn.in.find('\n', start)) != std::string::npos)
+	{
+		size_t end = newline;
+		if (end > start && conn.in[end - 1] == '\r')
+			end--;
+		handleLine(conn, conn.in.substr(start, end - start));
+		start = newline + 1;
+	}
+	conn.in.erase(0, start);
+}
+
+void	LoadGenerator::handleLine(Connection &conn, std::string const &line)
+{
+	size_t stamp = line.find(" PRIVMSG #");
+	if (stamp != std::string::npos)
+	{
+		stamp = line.find(":t", stamp);
+		if (stamp == std::string::npos)
+			return;
+		uint64_t sentAt = std::strtoull(line.c_str() + stamp + 2, nullptr, 10);
+		_latencies.push_back(static_cast<uint32_t>((nowNs() - sentAt) / 1000));
+		_delivered++;
+		return;
+	}
+	if (!conn.registered && isWelcomeReply(line))
+	{
+		conn.registered = true;
+		_registered++;
+		return;
+	}
+	if (!conn.joined && line.find("End of /NAMES list") != std::string::npos)
+	{
+		conn.joined = true;
+		_joined++;
+	}
+}
+
+void	LoadGenerator::waitFor(size_t const &counter, size_t target, const char *phase)
+{
+	uint64_t deadline = nowNs() + 30ull * 1000000000;
+	while (counter < target)
+	{
+		if (nowNs() > deadline)
+			throw std::runtime_error(std::string("timed out while ") + phase + ": " + std::to_string(counter) + "/" + std::to_string(target));
+		poll(100);
+	}
+}
+
+void	LoadGenerator::run()
+{
+	connectAll();
+	waitFor(_registered, _conns.size(), "registering");
+	for (Connection &conn : _conns)
+		queue(conn, "JOIN #bench" + std::to_string(conn.channel));
+	waitFor(_joined, _conns.size(), "joining");
+
+	// Pace against the wall clock: whatever fell behind during a slow iteration is caught up in the next one
+	size_t members = _conns.size() / _config.channels;
+	_latencies.reserve(static_cast<size_t>(_config.rate * _config.duration) * members);
+	uint64_t start = nowNs();
+	uint64_t end = start + static_cast<uint64_t>(_config.duration * 1e9);
+	size_t next = 0;
+	uint64_t now;
+	while ((now = nowNs()) < end)
+	{
+		uint64_t due = static_cast<uint64_t>((now - start) / 1e9 * _config.rate);
+		for (; _sent < due; _sent++)
+		{
+			Connection &conn = _conns[next];
+			next = (next + 1) % _conns.size();
+			queue(conn, "PRIVMSG #bench" + std::to_string(conn.channel) + " :t" + std::to_string(nowNs()));
+		}
+		poll(1);
+	}
+
+	// Drain: give the server a moment to deliver what is in flight
+	uint64_t expected = 0;
+	for (size_t i = 0; i < _sent; i++)
+	{
+		size_t channel = (i % _conns.size()) % _config.channels;
+		size_t size = _conns.size() / _config.channels + (channel < _conns.size() % _config.channels ? 1 : 0);
+		expected += size - 1;
+	}
+	uint64_t deadline = nowNs() + 2ull * 1000000000;
+	while (_delivered < expected && nowNs() < deadline)
+		poll(10);
+
+	std::cout << "expected deliveries: " << expected << "\n";
+	report((nowNs() - start) / 1e9);
+}
+
+void	LoadGenerator::report(double elapsed)
+{
+	std::cout << "clients: " << _conns.size() << ", channels: " << _config.channels
+		<< ", fan-out: " << _conns.size() / _config.channels - 1 << ", target rate: " << _config.rate << " msg/s\n";
+	std::cout << "sent: " << _sent << ", delivered: " << _delivered << " in " << elapsed << " s\n";
+	std::cout << "throughput: " << static_cast<uint64_t>(_delivered / elapsed) << " deliveries/s\n";
+	std::cout << "latency us: " << latencySummary(_latencies) << "\n";
+}
+
+int	main(int argc, char **argv)
+{
+	BenchConfig config;
+	bool valid = true;
+	for (int i = 1; i < argc && valid; i++)
+		valid = parseOption(argv[i], config);
+	if (config.channels == 0)
+		config.channels = std::min<size_t>(10, config.clients);
+	if (!valid || !validConfig(config))
+	{
+		std::cerr << "Usage: ./ircbench [--host=ip] [--port=n] [--password=pw] [--clients=n] [--channels=n]"
+			" [--rate=msg/s] [--duration=s] [--spawn=./ircserv]\n";
+		return 1;
+	}
+
+	rlimit limit;
+	if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < config.clients + 64)
+	{
+		limit.rlim_cur = std::min<rlim_t>(limit.rlim_max, config.clients + 64);
+		setrlimit(RLIMIT_NOFILE, &limit);
+	}
+
+	pid_t server = -1;
+	int status = 0;
+	try
+	{
+		if (!config.spawn.empty())
+			server = spawnServer(config.spawn, resolveAddress(config.host, config.port), config.password);
+		LoadGenerator generator(config);
+		generator.run();
+	}
+	catch (const std::exception &e)
+	{
+		std::cerr << "bench: " << e.what() << std::endl;
+		status = 1;
+	}
+	if (server > 0)
+		stopServer(server);
+	return status;
+}
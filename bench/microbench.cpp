@@ -0,0 +1,320 @@
+// In-process microbenchmarks for the hot paths: parsing, framing, channel broadcast and command dispatch.
+// Results are printed as JSON on stdout so runs can be diffed before and after a change.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "../Server.hpp"
+
+#define BENCH_MIN_TIME_NS 200000000 // A timed run lasts at least this long, iterations are doubled until it does
+
+template <typename T>
+static inline void	doNotOptimize(T const &value)
+{
+	asm volatile("" : : "r"(&value) : "memory");
+}
+
+static uint64_t	nowNs()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct	Result
+{
+	std::string	name;
+	uint64_t	iterations;
+	double		nsPerOp; // Median over the repeats
+	double		minNsPerOp;
+	double		itemsPerOp; // Lines, deliveries... handled by one operation
+	std::string	skipped;
+};
+
+struct	BenchOptions
+{
+	int			repeats = 5;
+	std::string	filter;
+};
+
+// Calibrates an iteration count, then times `repeats` runs of it. op(n) performs n operations
+static Result	measure(std::string const &name, double itemsPerOp, BenchOptions const &options, std::function<void(uint64_t)> const &op)
+{
+	uint64_t iterations = 1;
+	while (true)
+	{
+		uint64_t start = nowNs();
+		op(iterations);
+		if (nowNs() - start >= BENCH_MIN_TIME_NS / 4 || iterations >= (1ull << 30))
+			break;
+		iterations *= 2;
+	}
+	iterations *= 4;
+
+	std::vector<double> samples;
+	for (int i = 0; i < options.repeats; i++)
+	{
+		uint64_t start = nowNs();
+		op(iterations);
+		samples.push_back(static_cast<double>(nowNs() - start) / iterations);
+	}
+	std::sort(samples.begin(), samples.end());
+	std::cerr << name << ": " << samples[samples.size() / 2] << " ns/op\n";
+	return Result{name, iterations, samples[samples.size() / 2], samples.front(), itemsPerOp, ""};
+}
+
+class	ServerBench // Friend of Server, reaches the dispatch path without a listening socket
+{
+	private:
+		Server				_server;
+		std::vector<int>	_peers; // Far ends of the clients' sockets, drained after every batch
+
+		void	drain();
+
+	public:
+		ServerBench();
+		~ServerBench();
+
+		User	&connect(std::string const &nick);
+		void	dispatch(User &client, std::string_view line);
+		void	flush(); // Ends the loop iteration: queued output is written and the far ends drained
+};
+
+ServerBench::ServerBench() : _server(0, "bench") {}
+
+ServerBench::~ServerBench()
+{
+	for (int fd : _peers)
+		close(fd);
+}
+
+User	&ServerBench::connect(std::string const &nick)
+{
+	int pair[2];
+	if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, pair) < 0)
+		throw std::runtime_error("socketpair failed");
+	_peers.push_back(pair[1]);
+	User &client = _server._clients.emplace(nick, pair[0], _server._buffers);
+	client.setOutboundListener(&_server);
+	dispatch(client, "PASS bench");
+	dispatch(client, "NICK " + nick);
+	dispatch(client, "USER " + nick + " 0 * :bench");
+	flush();
+	return client;
+}
+
+void	ServerBench::dispatch(User &client, std::string_view line)
+{
+	std::optional<ParsedInput> parsed = _server._parser->parse(line);
+	if (parsed)
+		_server.dispatchCommand(client, *parsed);
+}
+
+void	ServerBench::drain()
+{
+	char sink[65536];
+	for (int fd : _peers)
+	{
+		while (recv(fd, sink, sizeof(sink), MSG_DONTWAIT) > 0)
+			;
+	}
+}
+
+void	ServerBench::flush()
+{
+	_server.finishIteration();
+	drain();
+}
+
+static Result	benchParse(std::string const &name, std::string const &line, BenchOptions const &options)
+{
+	Parser parser;
+	return measure(name, 1, options, [&](uint64_t n) {
+		for (uint64_t i = 0; i < n; i++)
+		{
+			std::optional<ParsedInput> parsed = parser.parse(line);
+			doNotOptimize(parsed);
+		}
+	});
+}
+
+static Result	benchFraming(BenchOptions const &options)
+{
+	// 100 pipelined lines handed over in recv() sized chunks, as a client flooding the server would
+	std::string input;
+	for (int i = 0; i < 100; i++)
+		input += "PRIVMSG #channel :pipelined message number " + std::to_string(i) + "\r\n";
+
+	BufferPool pool;
+	InputBuffer buffer(pool);
+	return measure("framing_pipelined_100_lines", 100, options, [&](uint64_t n) {
+		for (uint64_t i = 0; i < n; i++)
+		{
+			size_t offset = 0;
+			while (offset < input.size())
+			{
+				size_t room = 0;
+				char *dest = buffer.writeSpace(room);
+				size_t len = std::min(room, input.size() - offset);
+				std::memcpy(dest, input.data() + offset, len);
+				buffer.commit(len);
+				offset += len;
+
+				std::string_view line;
+				while (buffer.nextLine(line) != InputBuffer::NONE)
+					doNotOptimize(line);
+			}
+			buffer.release();
+		}
+	});
+}
+
+static Result	benchBroadcast(size_t members, BenchOptions const &options)
+{
+	std::string name = "broadcast_" + std::to_string(members) + "_members";
+	rlimit limit;
+	getrlimit(RLIMIT_NOFILE, &limit);
+	if (limit.rlim_max < 2 * members + 64) // A socket pair per member, like a real server's own socket per client
+		return Result{name, 0, 0, 0, 0, "RLIMIT_NOFILE too low"};
+	limit.rlim_cur = limit.rlim_max;
+	setrlimit(RLIMIT_NOFILE, &limit);
+
+	BufferPool pool;
+	ClientTable clients;
+	std::vector<int> peers; // peers[i] receives what users[i] is sent
+	std::vector<User*> users;
+	Channel channel("#bench", clients);
+	for (size_t i = 0; i < members; i++)
+	{
+		int pair[2];
+		if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, pair) < 0)
+			throw std::runtime_error("socketpair failed");
+		User &user = clients.emplace("m" + std::to_string(i), pair[0], pool);
+		channel.addUser(user);
+		users.push_back(&user);
+		peers.push_back(pair[1]);
+	}
+
+	// One operation: serialize once, queue for every member, write every queue out
+	char sink[65536];
+	Result result = measure(name, members, options, [&](uint64_t n) {
+		for (uint64_t i = 0; i < n; i++)
+		{
+			channel.broadcast(":sender!user@host PRIVMSG #bench :a message of average length for a channel");
+			bool pending = true;
+			while (pending)
+			{
+				pending = false;
+				for (size_t m = 0; m < users.size(); m++)
+				{
+					users[m]->flushSendQueue();
+					if (!users[m]->hasPendingOutput())
+						continue;
+					pending = true; // Its socket is full: empty it, the next pass writes the rest
+					while (recv(peers[m], sink, sizeof(sink), MSG_DONTWAIT) > 0)
+						;
+				}
+			}
+		}
+	});
+	for (User *user : users)
+	{
+		channel.removeUser(*user);
+		close(user->getSocket());
+	}
+	for (int fd : peers)
+		close(fd);
+	return result;
+}
+
+static Result	benchDispatch(std::string const &name, std::string const &line, BenchOptions const &options)
+{
+	// Includes writing the replies out every 64 commands, as the event loop would at the end of an iteration
+	ServerBench bench;
+	User &sender = bench.connect("sender");
+	for (int i = 0; i < 10; i++)
+		bench.dispatch(bench.connect("r" + std::to_string(i)), "JOIN #bench");
+	bench.dispatch(sender, "JOIN #bench");
+	bench.flush();
+
+	return measure(name, 1, options, [&](uint64_t n) {
+		for (uint64_t i = 0; i < n; i++)
+		{
+			bench.dispatch(sender, line);
+			if ((i & 63) == 63)
+				bench.flush();
+		}
+		bench.flush();
+	});
+}
+
+static void	printJson(std::vector<Result> const &results)
+{
+	std::cout << "{\n  \"benchmarks\": [\n";
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		Result const &r = results[i];
+		std::cout << "    {\"name\": \"" << r.name << "\"";
+		if (!r.skipped.empty())
+			std::cout << ", \"skipped\": \"" << r.skipped << "\"";
+		else
+		{
+			char numbers[256];
+			snprintf(numbers, sizeof(numbers),
+				", \"iterations\": %llu, \"ns_per_op\": %.1f, \"min_ns_per_op\": %.1f, \"ops_per_sec\": %.0f, \"items_per_op\": %.0f, \"items_per_sec\": %.0f",
+				static_cast<unsigned long long>(r.iterations), r.nsPerOp, r.minNsPerOp, 1e9 / r.nsPerOp, r.itemsPerOp, 1e9 / r.nsPerOp * r.itemsPerOp);
+			std::cout << numbers;
+		}
+		std::cout << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+	}
+	std::cout << "  ]\n}\n";
+}
+
+int	main(int argc, char **argv)
+{
+	BenchOptions options;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if (arg.compare(0, 10, "--repeats=") == 0)
+			options.repeats = std::max(1, std::atoi(arg.c_str() + 10));
+		else if (arg.compare(0, 9, "--filter=") == 0)
+			options.filter = arg.substr(9);
+		else
+		{
+			std::cerr << "Usage: ./ircmicrobench [--repeats=n] [--filter=substring]\n";
+			return 1;
+		}
+	}
+
+	typedef std::pair<std::string, std::function<Result()>> Bench;
+	std::vector<Bench> benches = {
+		{"parse_no_prefix", [&] { return benchParse("parse_no_prefix", "PRIVMSG #channel :Hello, how is everyone doing today?", options); }},
+		{"parse_prefix", [&] { return benchParse("parse_prefix", ":nick!user@host.example.com PRIVMSG #channel :Hello, how is everyone doing today?", options); }},
+		{"parse_15_params", [&] { return benchParse("parse_15_params", "MODE #channel +ooookl alice bob carol dave 10 key e f g h i j :trailing", options); }},
+		{"framing_pipelined_100_lines", [&] { return benchFraming(options); }},
+		{"broadcast_10_members", [&] { return benchBroadcast(10, options); }},
+		{"broadcast_1000_members", [&] { return benchBroadcast(1000, options); }},
+		{"broadcast_10000_members", [&] { return benchBroadcast(10000, options); }},
+		{"dispatch_privmsg_channel", [&] { return benchDispatch("dispatch_privmsg_channel", "PRIVMSG #bench :hello everyone", options); }},
+		{"dispatch_privmsg_user", [&] { return benchDispatch("dispatch_privmsg_user", "PRIVMSG r0 :hello there", options); }},
+		{"dispatch_unknown_command", [&] { return benchDispatch("dispatch_unknown_command", "FOO bar", options); }},
+	};
+
+	std::vector<Result> results;
+	for (Bench const &bench : benches)
+	{
+		if (bench.first.find(options.filter) != std::string::npos)
+			results.push_back(bench.second());
+	}
+	printJson(results);
+	return 0;
+}
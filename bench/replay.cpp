@@ -0,0 +1,394 @@
+// Replays a capture written by `ircserv --capture=file` against a server: the same connections open, send the same
+// lines in the same order and close, either at the recorded pacing or as fast as possible. A probe client messages
+// itself every 10 ms throughout, its round trips are the latency the replayed load causes.
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "BenchUtil.hpp"
+#include "../Capture.hpp"
+
+#define PROBE_INTERVAL_NS 10000000
+#define PROBE_NICK "rprobe"
+
+struct	ReplayConfig
+{
+	std::string	file;
+	std::string	host = "127.0.0.1";
+	int			port = 6667;
+	std::string	password = "replay"; // Replaces the PASS arguments the server accepted in the capture, rejected ones get a wrong one
+	bool		recordedPace = true; // false: send everything as fast as the server takes it
+	std::string	spawn;
+};
+
+struct	ReplayConnection
+{
+	int			fd = -1;
+	std::string	in; // Only used by the probe, replayed connections discard what they receive
+	std::string	out;
+	bool		writeInterest = false;
+	bool		closeWhenFlushed = false;
+};
+
+class	Replayer
+{
+	private:
+		ReplayConfig					_config;
+		sockaddr_in						_addr;
+		int								_epoll;
+		std::vector<ReplayConnection>	_conns; // [0] is the probe
+		std::unordered_map<uint64_t, size_t>	_index; // Captured connection id -> _conns
+		uint64_t						_lines;
+		uint64_t						_received;
+		uint64_t						_closedByServer;
+		uint64_t						_lastProbe;
+		bool							_probeRegistered;
+		std::vector<uint32_t>			_probeLatencies; // Microseconds
+
+		size_t	open();
+		void	close(size_t index);
+		void	queue(size_t index, std::string const &line);
+		void	flush(size_t index);
+		void	readFrom(size_t index);
+		void	handleProbeLine(std::string const &line);
+		void	poll(int timeout_ms);
+		void	probe();
+		bool	flushed() const;
+
+	public:
+		explicit Replayer(ReplayConfig const &config);
+		~Replayer();
+
+		void	run(std::vector<CaptureRecord> const &records);
+};
+
+Replayer::Replayer(ReplayConfig const &config) : _config(config), _addr(resolveAddress(config.host, config.port)), _epoll(epoll_create1(EPOLL_CLOEXEC)),
+	_lines(0), _received(0), _closedByServer(0), _lastProbe(0), _probeRegistered(false)
+{
+	if (_epoll < 0)
+		throw std::runtime_error("epoll_create1 failed");
+}
+
+Replayer::~Replayer()
+{
+	for (ReplayConnection &conn : _conns)
+	{
+		if (conn.fd >= 0)
+			::close(conn.fd);
+	}
+	::close(_epoll);
+}
+
+size_t	Replayer::open()
+{
+	size_t index = _conns.size();
+	_conns.emplace_back();
+	_conns[index].fd = connectTo(_addr);
+	epoll_event event = {};
+	event.events = EPOLLIN;
+	event.data.u64 = index;
+	epoll_ctl(_epoll, EPOLL_CTL_ADD, _conns[index].fd, &event);
+	return index;
+}
+
+void	Replayer::close(size_t index)
+{
+	ReplayConnection &conn = _conns[index];
+	if (conn.fd < 0)
+		return;
+	::close(conn.fd); // Also drops it from the epoll set
+	conn.fd = -1;
+	conn.out.clear();
+}
+
+void	Replayer::queue(size_t index, std::string const &line)
+{
+	ReplayConnection &conn = _conns[index];
+	if (conn.fd < 0)
+		return;
+	bool idle = conn.out.empty();
+	conn.out += line;
+	conn.out += "\r\n";
+	if (idle)
+		flush(index);
+}
+
+void	Replayer::flush(size_t index)
+{
+	ReplayConnection &conn = _conns[index];
+	while (conn.fd >= 0 && !conn.out.empty())
+	{
+		ssize_t written = send(conn.fd, conn.out.data(), conn.out.size(), MSG_NOSIGNAL);
+		if (written < 0 && errno == EINTR)
+			continue;
+		if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			break;
+		if (written < 0)
+		{
+			_closedByServer++;
+			close(index);
+			return;
+		}
+		conn.out.erase(0, written);
+	}
+	if (conn.out.empty() && conn.closeWhenFlushed)
+	{
+		close(index);
+		return;
+	}
+
+	bool pending = !conn.out.empty();
+	if (conn.fd < 0 || pending == conn.writeInterest)
+		return;
+	conn.writeInterest = pending;
+	epoll_event event = {};
+	event.events = EPOLLIN | (pending ? static_cast<uint32_t>(EPOLLOUT) : 0);
+	event.data.u64 = index;
+	epoll_ctl(_epoll, EPOLL_CTL_MOD, conn.fd, &event);
+}
+
+void	Replayer::readFrom(size_t index)
+{
+	ReplayConnection &conn = _conns[index];
+	char buffer[65536];
+	while (conn.fd >= 0)
+	{
+		ssize_t received = recv(conn.fd, buffer, sizeof(buffer), 0);
+		if (received < 0 && errno == EINTR)
+			continue;
+		if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			return;
+		if (received <= 0)
+		{
+			if (index == 0)
+				throw std::runtime_error("server closed the probe connection");
+			_closedByServer++;
+			close(index);
+			return;
+		}
+		_received += received;
+		if (index != 0)
+			continue;
+
+		conn.in.append(buffer, received);
+		size_t start = 0;
+		size_t newline;
+		while ((newline = conn.in.find('\n', start)) != std::string::npos)
+		{
+			handleProbeLine(conn.in.substr(start, newline - start));
+			start = newline + 1;
+		}
+		conn.in.erase(0, start);
+	}
+}
+
+void	Replayer::handleProbeLine(std::string const &line)
+{
+	if (isWelcomeReply(line))
+		_probeRegistered = true;
+	size_t stamp = line.find(" PRIVMSG " PROBE_NICK " :t");
+	if (stamp != std::string::npos)
+		_probeLatencies.push_back(static_cast<uint32_t>((nowNs() - std::strtoull(line.c_str() + stamp + 12 + strlen(PROBE_NICK), nullptr, 10)) / 1000));
+}
+
+void	Replayer::poll(int timeout_ms)
+{
+	epoll_event events[256];
+	int ready = epoll_wait(_epoll, events, 256, timeout_ms);
+	for (int i = 0; i < ready; i++)
+	{
+		size_t index = events[i].data.u64;
+		if (events[i].events & EPOLLOUT)
+			flush(index);
+		if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+			readFrom(index);
+	}
+	probe();
+}
+
+void	Replayer::probe()
+{
+	uint64_t now = nowNs();
+	if (!_probeRegistered || now - _lastProbe < PROBE_INTERVAL_NS)
+		return;
+	_lastProbe = now;
+	queue(0, "PRIVMSG " PROBE_NICK " :t" + std::to_string(now));
+}
+
+bool	Replayer::flushed() const
+{
+	for (ReplayConnection const &conn : _conns)
+	{
+		if (conn.fd >= 0 && !conn.out.empty())
+			return false;
+	}
+	return true;
+}
+
+void	Replayer::run(std::vector<CaptureRecord> const &records)
+{
+	open(); // The probe
+	queue(0, "PASS " + _config.password);
+	queue(0, "NICK " PROBE_NICK);
+	queue(0, "USER " PROBE_NICK " 0 * :replay probe");
+	uint64_t deadline = nowNs() + 5000000000ull;
+	while (!_probeRegistered && nowNs() < deadline)
+		poll(10);
+	if (!_probeRegistered)
+		throw std::runtime_error("probe could not register, check --password");
+
+	uint64_t start = nowNs();
+	for (size_t i = 0; i < records.size(); i++)
+	{
+		CaptureRecord const &record = records[i];
+		if (_config.recordedPace)
+		{
+			uint64_t due = record.time - records[0].time; // The capture may have started long before the first client
+			while (nowNs() - start < due)
+				poll(static_cast<int>(std::min<uint64_t>((due - (nowNs() - start)) / 1000000, 1)));
+		}
+		else if ((i & 63) == 0)
+			poll(0); // Keep reading, a server whose replies pile up would drop us for SendQ
+
+		if (record.type == CaptureRecord::CONNECT)
+			_index[record.connection] = open();
+		else if (_index.count(record.connection) == 0)
+			continue; // Connected before the capture started
+		else if (record.type == CaptureRecord::LINE)
+		{
+			_lines++;
+			if (record.data == CAPTURE_PASS_ACCEPTED)
+				queue(_index[record.connection], "PASS " + _config.password);
+			else if (record.data == CAPTURE_PASS_REJECTED)
+				queue(_index[record.connection], "PASS " + _config.password + "-rejected"); // Fails again, like in the capture
+			else
+				queue(_index[record.connection], record.data);
+		}
+		else if (record.type == CaptureRecord::DISCONNECT)
+		{
+			size_t index = _index[record.connection];
+			_conns[index].closeWhenFlushed = true;
+			flush(index);
+		}
+	}
+	while (!flushed())
+		poll(1);
+
+	// One more round trip after everything was sent: the server is through the replayed input
+	size_t probes = _probeLatencies.size();
+	_lastProbe = 0;
+	deadline = nowNs() + 10000000000ull;
+	while (_probeLatencies.size() == probes && nowNs() < deadline)
+		poll(1);
+	double elapsed = (nowNs() - start) / 1e9;
+
+	std::cout << "capture: " << records.size() << " records, " << _conns.size() - 1 << " connections, "
+		<< (records.empty() ? 0 : (records.back().time - records.front().time) / 1e9) << " s recorded\n";
+	std::cout << "replay (" << (_config.recordedPace ? "recorded pace" : "max pace") << "): " << _lines << " lines in " << elapsed << " s, "
+		<< static_cast<uint64_t>(_lines / elapsed) << " lines/s, " << _received << " bytes received, "
+		<< _closedByServer << " connections closed by the server\n";
+	std::cout << "probe round trip us: " << latencySummary(_probeLatencies) << "\n";
+}
+
+static bool	parseOption(std::string const &arg, ReplayConfig &config)
+{
+	size_t eq = arg.find('=');
+	if (arg.compare(0, 2, "--") != 0 || eq == std::string::npos)
+	{
+		config.file = arg;
+		return !arg.empty();
+	}
+	std::string key = arg.substr(2, eq - 2);
+	std::string value = arg.substr(eq + 1);
+	try
+	{
+		if (key == "host")
+			config.host = value;
+		else if (key == "port")
+			config.port = std::stoi(value);
+		else if (key == "password")
+			config.password = value;
+		else if (key == "pace" && (value == "recorded" || value == "max"))
+			config.recordedPace = (value == "recorded");
+		else if (key == "spawn")
+			config.spawn = value;
+		else
+			return false;
+	}
+	catch (const std::exception &e)
+	{
+		return false;
+	}
+	return true;
+}
+
+int	main(int argc, char **argv)
+{
+	ReplayConfig config;
+	for (int i = 1; i < argc; i++)
+	{
+		if (!parseOption(argv[i], config))
+			config.file.clear();
+	}
+	if (config.file.empty())
+	{
+		std::cerr << "Usage: ./ircreplay <capture file> [--pace=recorded|max] [--host=ip] [--port=n] [--password=pw] [--spawn=./ircserv]\n";
+		return 1;
+	}
+
+	FILE *file = fopen(config.file.c_str(), "rb");
+	if (!file || !Capture::readHeader(file))
+	{
+		std::cerr << "replay: " << config.file << " is not a capture file\n";
+		if (file)
+			fclose(file);
+		return 1;
+	}
+	std::vector<CaptureRecord> records;
+	CaptureRecord record;
+	while (Capture::read(file, record))
+		records.push_back(record);
+	bool malformed = !feof(file); // A record cut off by the end of the file just ends the capture
+	fclose(file);
+	if (malformed)
+	{
+		std::cerr << "replay: " << config.file << " has a malformed record after " << records.size() << " records\n";
+		return 1;
+	}
+
+	rlimit limit;
+	if (getrlimit(RLIMIT_NOFILE, &limit) == 0)
+	{
+		limit.rlim_cur = limit.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &limit);
+	}
+
+	pid_t server = -1;
+	int status = 0;
+	try
+	{
+		if (!config.spawn.empty())
+			server = spawnServer(config.spawn, resolveAddress(config.host, config.port), config.password);
+		Replayer replayer(config);
+		replayer.run(records);
+	}
+	catch (const std::exception &e)
+	{
+		std::cerr << "replay: " << e.what() << std::endl;
+		status = 1;
+	}
+	if (server > 0)
+		stopServer(server);
+	return status;
+}
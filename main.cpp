@@ -1,10 +1,56 @@
 #include "Server.hpp"
 
+static size_t	parseSize(std::string const &value)
+{
+	size_t used = 0;
+	unsigned long size = std::stoul(value, &used);
+	if (used != value.size() || size == 0)
+		throw std::invalid_argument(value);
+	return size;
+}
+
+static bool	parseOption(std::string const &arg, ServerConfig &config)
+{
+	size_t eq = arg.find('=');
+	if (arg.compare(0, 2, "--") != 0 || eq == std::string::npos)
+		return false;
+
+	std::string key = arg.substr(2, eq - 2);
+	std::string value = arg.substr(eq + 1);
+	if (key == "backend" && (value == "epoll" || value == "poll"))
+		config.backend = value;
+	else if (key == "sendq")
+		config.sendq = parseSize(value);
+	else if (key == "capture" && !value.empty())
+		config.capture = value;
+	else if (key == "ping-interval")
+		config.pingInterval = parseSize(value);
+	else if (key == "ping-timeout")
+		config.pingTimeout = parseSize(value);
+	else if (key == "register-timeout")
+		config.registrationTimeout = parseSize(value);
+	else if (key == "idle-timeout")
+		config.idleTimeout = (value == "0") ? 0 : parseSize(value);
+	else if (key == "flood-rate")
+		config.floodRate = (value == "0") ? 0 : parseSize(value);
+	else if (key == "flood-burst")
+		config.floodBurst = parseSize(value);
+	else if (key == "flood-queue")
+		config.floodQueue = (value == "0") ? 0 : parseSize(value);
+	else if (key == "log")
+		return Logger::parseLevel(value, config.logLevel);
+	else
+		return false;
+	return true;
+}
+
 int main(int argc, char **argv)
 {
-	if (argc != 3)
+	if (argc < 3)
 	{
-		std::cerr << "Usage: ./ircserv <port> <password>\n";
+		std::cerr << "Usage: ./ircserv <port> <password> [--backend=epoll|poll] [--sendq=bytes] [--log=debug|info|warn|error|off] [--capture=file]"
+			" [--ping-interval=s] [--ping-timeout=s] [--register-timeout=s] [--idle-timeout=s]"
+			" [--flood-rate=n] [--flood-burst=n] [--flood-queue=bytes]\n";
 		return 1;
 	}
 
@@ -21,16 +67,38 @@ int main(int argc, char **argv)
 
 	std::string password = argv[2];
 
-	try 
+	ServerConfig config;
+	for (int i = 3; i < argc; i++)
+	{
+		bool valid = false;
+		try
+		{
+			valid = parseOption(argv[i], config);
+		}
+		catch (const std::exception& e)
+		{
+			valid = false;
+		}
+		if (!valid)
+		{
+			std::cerr << "Error: Invalid option " << argv[i] << "\n";
+			return 1;
+		}
+	}
+
+	Logger::start(config.logLevel);
+	try
 	{
-		Server server(port, password);
+		Server server(port, password, config);
 		server.run();
 	}
-	catch (const std::exception& e) 
+	catch (const std::exception& e)
 	{
+		Logger::stop();
 		std::cerr << "Fatal Error: " << e.what() << std::endl;
 		return 1;
 	}
 
+	Logger::stop();
 	return 0;
 }